@@ -0,0 +1,146 @@
+#include "code_map.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cpu/cpu.h"
+
+namespace nes {
+
+namespace {
+
+constexpr char kMagic[4] = { 'N', 'A', 'O', 'T' };
+
+}  // namespace
+
+uint64_t CodeMap::HashPrgRom(const Cartridge &cartridge) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint8_t byte : cartridge.prg_rom) {
+    hash ^= byte;
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+bool CodeMap::Analyze(const Cartridge &cartridge) {
+  if (cartridge.mapper_number != 0 || cartridge.prg_rom.empty()) {
+    std::cerr << std::format("Unsupported mapper: {}\n", cartridge.mapper_number);
+    return false;
+  }
+
+  // See https://www.nesdev.org/wiki/NROM
+  auto read = [&cartridge](uint16_t address) -> uint8_t {
+    return cartridge.prg_rom[(address - 0x8000) % cartridge.prg_rom.size()];
+  };
+  auto read16 = [&read](uint16_t address) -> uint16_t {
+    return read(address) | (read(address + 1) << 8);
+  };
+
+  rom_hash = HashPrgRom(cartridge);
+  entries.clear();
+
+  std::set<uint16_t> found;
+  std::vector<uint16_t> worklist = {
+    read16(0xFFFA), read16(0xFFFC), read16(0xFFFE)
+  };
+
+  while (!worklist.empty()) {
+    uint16_t pc = worklist.back();
+    worklist.pop_back();
+
+    if (pc < 0x8000 || !found.insert(pc).second) {
+      continue;
+    }
+
+    // Walk the straight-line run from this entry point.
+    while (pc >= 0x8000) {
+      const Cpu::Opcode &opcode_obj = Cpu::LookupOpcode(read(pc));
+      if (opcode_obj.func == nullptr) {
+        break;  // Data, or an unofficial opcode we can't run anyway.
+      }
+
+      uint16_t operand = opcode_obj.bytes == 3 ? read16(pc + 1) : read(pc + 1);
+      uint16_t next = pc + opcode_obj.bytes;
+
+      if (opcode_obj.addressing_mode == Cpu::kRelative) {
+        worklist.push_back(next + static_cast<int8_t>(operand));
+        worklist.push_back(next);
+        break;
+      }
+
+      bool stop = true;
+      switch (opcode_obj.opcode) {
+        case 0x20:  // JSR
+          worklist.push_back(operand);
+          worklist.push_back(next);
+          break;
+        case 0x4C:  // JMP
+          worklist.push_back(operand);
+          break;
+        case 0x00:  // BRK, IRQ vector is already queued.
+        case 0x6C:  // JMP (indirect), resolved at runtime.
+        case 0x40:  // RTI
+        case 0x60:  // RTS
+          break;
+        default:
+          stop = false;
+          break;
+      }
+
+      if (stop) {
+        break;
+      }
+      pc = next;
+    }
+  }
+
+  entries.assign(found.begin(), found.end());
+  return true;
+}
+
+bool CodeMap::Save(const std::string &path) const {
+  std::ofstream ofs(path, std::ios::binary);
+  if (!ofs.is_open()) {
+    std::cerr << std::format("Cannot write: {}\n", path);
+    return false;
+  }
+
+  uint32_t count = entries.size();
+  ofs.write(kMagic, sizeof(kMagic));
+  ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  ofs.write(reinterpret_cast<const char *>(&rom_hash), sizeof(rom_hash));
+  ofs.write(reinterpret_cast<const char *>(entries.data()),
+            entries.size() * sizeof(uint16_t));
+
+  return ofs.good();
+}
+
+bool CodeMap::Load(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+
+  char magic[4];
+  uint32_t count = 0;
+  ifs.read(magic, sizeof(magic));
+  ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+  ifs.read(reinterpret_cast<char *>(&rom_hash), sizeof(rom_hash));
+  if (!ifs || !std::equal(magic, magic + 4, kMagic) || count > 0x10000) {
+    std::cerr << std::format("Invalid code map: {}\n", path);
+    return false;
+  }
+
+  entries.resize(count);
+  ifs.read(reinterpret_cast<char *>(entries.data()), count * sizeof(uint16_t));
+
+  return ifs.good();
+}
+
+}  // namespace nes
@@ -0,0 +1,31 @@
+#ifndef NES_EMULATOR_AOT_CODE_MAP_H_
+#define NES_EMULATOR_AOT_CODE_MAP_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cartridge/cartridge.h"
+
+namespace nes {
+
+// Code reachable from the NMI/RESET/IRQ vectors of a fixed-PRG (mapper 0)
+// ROM, found offline by nes-aot. Machine feeds the entry points to
+// Cpu::Predecode() so the block cache starts warm instead of decoding on
+// first execution. Indirect jumps are not followed; whatever they reach
+// is decoded lazily at runtime as usual.
+struct CodeMap {
+  uint64_t rom_hash = 0;
+  std::vector<uint16_t> entries;  // Block entry points, sorted.
+
+  // FNV-1a over PRG ROM, so a map is never applied to another ROM.
+  static uint64_t HashPrgRom(const Cartridge &cartridge);
+
+  bool Analyze(const Cartridge &cartridge);
+  bool Save(const std::string &path) const;
+  bool Load(const std::string &path);
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_AOT_CODE_MAP_H_
@@ -1,7 +1,9 @@
 #include "bus.h"
 
 #include <cstdint>
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <format>
 #include <iostream>
@@ -15,111 +17,155 @@ void Bus::Connect(std::array<uint8_t, 0x0800> &memory, Cartridge &cartridge, PPU
   cartridge_ = &cartridge;
   ppu_ = &ppu;
   joypad_ = &joypad;
+  stats_.Connect(cartridge);
+
+  // See https://www.nesdev.org/wiki/CPU_memory_map
+  pages_.fill(Page {});
+
+  // 2KB internal RAM, mirrored four times.
+  for (int mirror = 0; mirror < 4; ++mirror) {
+    MapPages(mirror * 0x08, 0x08, memory_->data(), memory_->data(), kOpenBus);
+  }
+
+  MapPages(0x20, 0x20, nullptr, nullptr, kPpuRegisters);
+  MapPages(0x40, 0x01, nullptr, nullptr, kIoRegisters);
+  MapPages(0x41, 0x1F, nullptr, nullptr, kCartridge);
+
+  // PRG RAM, if the cartridge has any. Pages of battery-backed RAM start
+  // out read only, see FlushSaveRam().
+  int prg_ram_pages = std::min<int>(cartridge_->prg_ram.size() / 0x100, 0x20);
+  if (cartridge_->save_ram.is_open()) {
+    MapPages(0x60, prg_ram_pages, cartridge_->prg_ram.data(), nullptr,
+             kSaveRam);
+  } else {
+    MapPages(0x60, prg_ram_pages, cartridge_->prg_ram.data(),
+             cartridge_->prg_ram.data(), kOpenBus);
+  }
+
+  // PRG ROM, one 8KB mapper window at a time. Writes go to the mapper.
+  for (int slot = 0; slot < 4; ++slot) {
+    MapPrgWindow(slot);
+  }
+  cartridge_->mapper->TakeChangedPrgWindows();
+}
+
+bool Bus::FlushSaveRam(bool wait) {
+  if (!cartridge_->save_ram.is_open()) {
+    return true;
+  }
+
+  // Make every page trap its next write again.
+  for (Page &page : pages_) {
+    if (page.handler == kSaveRam) {
+      page.write = nullptr;
+    }
+  }
+  return cartridge_->save_ram.Flush(wait);
+}
+
+void Bus::MapPrgWindow(int slot) {
+  MapPages(0x80 + slot * 0x20, 0x20, cartridge_->mapper->prg_window(slot),
+           nullptr, kCartridge);
 }
 
-void Bus::CpuWrite8Bit(uint16_t address, uint8_t value) {
-  if (address >= 0x0800 && address <= 0x0FFF) {
-    (*memory_)[address - 0x0800] = value;
-  } else if (address >= 0x1000 && address <= 0x17FF) {
-    (*memory_)[address - 0x1000] = value;
-  } else if (address >= 0x1800 && address <= 0x1FFF) {
-    (*memory_)[address - 0x1800] = value;
-  } else if ((address >= 0x2000 && address <= 0x2007)) {
-    // PPU
-    ppu_->Write(address, value);
-  } else if (address >= 0x4000 && address <= 0x4017) {
-    // TODO(yangsiyu):
-    if (address == 0x4014) {  // OAMDMA
-      std::copy(memory_->begin() + (value << 8),
-                memory_->begin() + (value << 8) + 256,
-                ppu_->OAM.begin());
-    } else {
+void Bus::MapPages(int first, int count, const uint8_t *read, uint8_t *write,
+                   PageHandler handler) {
+  for (int i = 0; i < count; ++i) {
+    Page &page = pages_[first + i];
+    page.read = read != nullptr ? read + i * 0x100 : nullptr;
+    page.write = write != nullptr ? write + i * 0x100 : nullptr;
+    page.handler = handler;
+  }
+}
+
+uint8_t Bus::ReadHandler(PageHandler handler, uint16_t address) {
+  switch (handler) {
+    case kPpuRegisters: {
+      // Mirrors of $2000-$2007 (repeats every 8 bytes)
+      return ppu_->Read(0x2000 + (address & 0x07));
+    }
+    case kIoRegisters: {
       // TODO(yangsiyu):
-      if (address == 0x4016) {
-        bool strobe = (value & 0x1) > 0;
-        joypad_->set_strobe(strobe);
+      if (address == 0x4016) {  // Joypad1
+        return joypad_->GetCurrentKey() ? 1 : 0;
       }
-      // nes_assert(false, std::format("Unsupported write: {:#x}", address));
+      return 0;
     }
-  } else if (address >= 0x4020) {
-    // Cartridge
-    if (address >= 0x6000 && address <= 0x7FFF) {
-      cartridge_->prg_ram[address - 0x6000] = value;
-    } else {
-      nes_assert(false, std::format("Unsupported write: {:#x}", address));
+    case kCartridge: {
+      // TODO(yangsiyu): Expansion area.
+      return 0;
     }
-  } else {
-    if (address >= memory_->size()) {
-      nes_assert(false, std::format("Write out of memory: {:#x}", address));
+    case kOpenBus:
+    default: {
+      return 0;
     }
-    (*memory_)[address] = value;
   }
 }
 
-void Bus::CpuWrite16Bit(uint16_t address, uint16_t value) {
-  CpuWrite8Bit(address, value);
-  CpuWrite8Bit(address + 1, value >> 8);
-}
-
-uint8_t Bus::CpuRead8Bit(uint16_t address) {
-  if (address >= 0x0800 && address <= 0x0FFF) {
-    return (*memory_)[address - 0x0800];
-  } else if (address >= 0x1000 && address <= 0x17FF) {
-    return (*memory_)[address - 0x1000];
-  } else if (address >= 0x1800 && address <= 0x1FFF) {
-    return (*memory_)[address - 0x1800];
-  } else if (address >= 0x2000 && address <= 0x2007) {
-    // PPU
-    return ppu_->Read(address);
-  } else if (address >= 0x2008 && address <= 0x3FFF) {
-    // Mirrors of $2000–$2007 (repeats every 8 bytes)
-    // std::cout << std::format("Debug: {:#x}, mirror: {:#x}\n", address, 0x2000 + (address - 0x2000) % 8);
-    return ppu_->Read(0x2000 + (address - 0x2000) % 8);
-  } else if (address >= 0x4000 && address <= 0x4017) {
-    // TODO(yangsiyu):
-    if (address == 0x4016) {  // Joypad1
-      return joypad_->GetCurrentKey() ? 1 : 0;
-    } else {
-      return 0;
+void Bus::WriteHandler(PageHandler handler, uint16_t address, uint8_t value) {
+  switch (handler) {
+    case kPpuRegisters: {
+      ppu_->Write(0x2000 + (address & 0x07), value);
+      break;
     }
-  } else if (address >= 0x4020) {
-    // Cartridge
-    if (address >= 0x4020 && address <= 0x5FFF) {
+    case kIoRegisters: {
       // TODO(yangsiyu):
-      return 0;
-    } else if (address >= 0x6000 && address <= 0x7FFF) {
-      return cartridge_->prg_ram[address - 0x6000];
-    } else if (address >= 0x8000) {
-      if (cartridge_->mapper == 0) {
-        // See https://www.nesdev.org/wiki/NROM
-        if (cartridge_->prg_rom.size() == 16384) {
-          if (address <= 0xBFFF) {
-            return cartridge_->prg_rom[address - 0x8000];
-          } else {
-            return cartridge_->prg_rom[address - 0xC000];
+      if (address == 0x4014) {  // OAMDMA
+        // See https://www.nesdev.org/wiki/PPU_registers#OAMDMA
+        // Any page can be the source. Memory pages are copied straight
+        // from the host, anything else is read byte by byte like the DMA
+        // unit would. The CPU charges the stall, see BasicCpu::Write().
+        const uint8_t *source = CpuReadPointer(value << 8);
+        std::array<uint8_t, 256> buffer;
+        if (source == nullptr) {
+          for (int i = 0; i < 256; ++i) {
+            buffer[i] = CpuRead8Bit((value << 8) | i);
           }
-        } else {
-          return cartridge_->prg_rom[address - 0x8000];
+          source = buffer.data();
         }
-      } else {
-        nes_assert(false, std::format("Unsupported mapper: {:#x}",
-                                      cartridge_->mapper));
+        ppu_->WriteOamDma(source);
+      } else if (address == 0x4016) {
+        bool strobe = (value & 0x1) > 0;
+        joypad_->set_strobe(strobe);
       }
-    } else {
-      nes_assert(false, std::format("Unsupported access: {:#x}", address));
+      break;
     }
-  } else {
-    if (address >= memory_->size()) {
-      nes_assert(false, std::format("Read out of memory: {:#x}", address));
+    case kCartridge: {
+      if (address < 0x8000) {
+        nes_assert(false, std::format("Unsupported write: {:#x}", address));
+      }
+
+      // The PPU has to render up to this point with the old CHR banks and
+      // mirroring, and its A12 rises so far have to reach the mapper's IRQ
+      // counter before the write does.
+      ppu_->Sync();
+
+      // Only the windows the register write moved are repointed.
+      Mapper &mapper = *cartridge_->mapper;
+      mapper.Write(address, value);
+      for (uint8_t changed = mapper.TakeChangedPrgWindows(); changed != 0;
+           changed &= changed - 1) {
+        MapPrgWindow(std::countr_zero(changed));
+      }
+
+      // The write may have moved the next scanline IRQ.
+      ppu_->ScheduleEvents();
+      break;
+    }
+    case kSaveRam: {
+      // The first write to the page since the last flush marks it dirty
+      // and maps it writable, so the rest are plain stores.
+      int page = (address >> 8) - 0x60;
+      cartridge_->save_ram.MarkDirty(page);
+      pages_[address >> 8].write = cartridge_->prg_ram.data() + page * 0x100;
+      pages_[address >> 8].write[address & 0xFF] = value;
+      break;
+    }
+    case kOpenBus:
+    default: {
+      break;
     }
-    return (*memory_)[address];
   }
 }
 
-uint16_t Bus::CpuRead16Bit(uint16_t address) {
-  uint16_t ret = CpuRead8Bit(address);
-  ret |= (CpuRead8Bit(address + 1) << 8);
-  return ret;
-}
-
 }  // namespace nes
@@ -4,6 +4,7 @@
 #include <array>
 #include <cstdint>
 
+#include "bus/bus_stats.h"
 #include "cartridge/cartridge.h"
 #include "ppu/ppu.h"
 #include "joypad/joypad.h"
@@ -11,17 +12,109 @@
 namespace nes {
 class Bus {
  public:
+  // Writes to $4014 start an OAM DMA, which halts the CPU.
+  static constexpr bool kHasOamDma = true;
+
+  // The page the CPU's block cache files code at address under, with RAM
+  // mirrors folded together, or -1 if the CPU can't write there.
+  static int CodePage(uint16_t address) {
+    if (address <= 0x1FFF) {
+      // 2KB internal RAM and its mirrors.
+      return (address & 0x07FF) >> 8;
+    } else if (address >= 0x6000 && address <= 0x7FFF) {
+      // PRG RAM
+      return address >> 8;
+    }
+    return -1;  // Not writable, never invalidated.
+  }
+
+  // Builds the memory map, so the cartridge must already be loaded.
   void Connect(std::array<uint8_t, 0x0800> &memory, Cartridge &cartridge, PPU &ppu, Joypad &joypad);
 
-  void CpuWrite8Bit(uint16_t address, uint8_t value);
+  // Defined here so the CPU inlines the page table lookup; only register
+  // accesses leave the fast path.
+  void CpuWrite8Bit(uint16_t address, uint8_t value) {
+    const Page &page = pages_[address >> 8];
+    stats_.CountWrite(address);
+    if (page.write != nullptr) {
+      page.write[address & 0xFF] = value;
+    } else {
+      WriteHandler(page.handler, address, value);
+    }
+  }
+
+  void CpuWrite16Bit(uint16_t address, uint16_t value) {
+    CpuWrite8Bit(address, value);
+    CpuWrite8Bit(address + 1, value >> 8);
+  }
+
+  uint8_t CpuRead8Bit(uint16_t address) {
+    const Page &page = pages_[address >> 8];
+    stats_.CountRead(address, page.read);
+    if (page.read != nullptr) {
+      return page.read[address & 0xFF];
+    }
+    return ReadHandler(page.handler, address);
+  }
+
+  uint16_t CpuRead16Bit(uint16_t address) {
+    return CpuRead8Bit(address) | (CpuRead8Bit(address + 1) << 8);
+  }
 
-  void CpuWrite16Bit(uint16_t address, uint16_t value);
+  // Host address backing a CPU address for plain memory (RAM, PRG RAM and
+  // PRG ROM), nullptr for registers and unmapped space. A 256-byte page is
+  // always contiguous on the host side.
+  //
+  // Counting builds (see bus_stats.h) never hand out host memory, so the
+  // CPU's instruction fetches and zero page reads come through
+  // CpuRead8Bit() and get counted too, at the cost of its fast paths.
+  const uint8_t *CpuReadPointer(uint16_t address) {
+    if constexpr (BusStatsPolicy::kEnabled) {
+      return nullptr;
+    }
+    const Page &page = pages_[address >> 8];
+    return page.read != nullptr ? page.read + (address & 0xFF) : nullptr;
+  }
 
-  uint8_t CpuRead8Bit(uint16_t address);
+  // The /IRQ line of the cartridge connector. Only mappers drive it so far.
+  bool irq() const { return cartridge_->mapper->irq(); }
 
-  uint16_t CpuRead16Bit(uint16_t address);
+  BusStatsPolicy &stats() { return stats_; }
+
+  // Writes battery-backed PRG RAM written since the last call back to the
+  // save file, waiting for the disk only if wait is true. Call it every
+  // so often and before exiting.
+  bool FlushSaveRam(bool wait);
 
  private:
+  // What handles accesses to a page that has no host memory behind it.
+  enum PageHandler : uint8_t {
+    kOpenBus = 0,
+    kPpuRegisters,  // $2000-$3FFF, mirrored every 8 bytes.
+    kIoRegisters,   // $4000-$40FF, OAM DMA, joypad and APU.
+    kCartridge,     // Expansion area, mapper registers.
+    kSaveRam,       // Battery-backed PRG RAM page not written since a flush.
+  };
+
+  // One entry per 256-byte page of the CPU address space. Plain memory
+  // has a host pointer (read only for ROM), everything else goes through
+  // the handler.
+  struct Page {
+    const uint8_t *read = nullptr;
+    uint8_t *write = nullptr;
+    PageHandler handler = kOpenBus;
+  };
+
+  void MapPages(int first, int count, const uint8_t *read, uint8_t *write,
+                PageHandler handler);
+  // Points the 8KB at $8000 + slot * $2000 at the mapper's PRG window.
+  void MapPrgWindow(int slot);
+  uint8_t ReadHandler(PageHandler handler, uint16_t address);
+  void WriteHandler(PageHandler handler, uint16_t address, uint8_t value);
+
+  std::array<Page, 256> pages_;
+  [[no_unique_address]] BusStatsPolicy stats_;
+
   std::array<uint8_t, 0x0800> *memory_;
   Cartridge *cartridge_;
   PPU *ppu_;
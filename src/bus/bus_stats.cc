@@ -0,0 +1,48 @@
+#include "bus_stats.h"
+
+#include <algorithm>
+#include <format>
+#include <ostream>
+
+#include "cartridge/cartridge.h"
+
+namespace nes {
+
+void BusHistogram::WriteCsv(std::ostream &out, uint64_t frame) const {
+  auto write = [&out, frame](const char *kind, std::size_t count,
+                             const uint32_t *reads, const uint32_t *writes) {
+    for (std::size_t i = 0; i < count; ++i) {
+      uint32_t r = reads[i];
+      uint32_t w = writes != nullptr ? writes[i] : 0;
+      if (r != 0 || w != 0) {
+        out << std::format("{},{},{:#x},{},{}\n", frame, kind, i, r, w);
+      }
+    }
+  };
+
+  write("page", page_reads.size(), page_reads.data(), page_writes.data());
+  write("ppu", ppu_reads.size(), ppu_reads.data(), ppu_writes.data());
+  write("io", io_reads.size(), io_reads.data(), io_writes.data());
+  write("prg_bank", prg_bank_reads.size(), prg_bank_reads.data(), nullptr);
+}
+
+void BusStats::Connect(const Cartridge &cartridge) {
+  prg_rom_ = cartridge.prg_rom.data();
+  prg_rom_end_ = prg_rom_ + cartridge.prg_rom.size();
+  current_ = BusHistogram {};
+  current_.prg_bank_reads.assign((cartridge.prg_rom.size() + 0x1FFF) / 0x2000, 0);
+  last_frame_ = current_;
+}
+
+void BusStats::EndFrame() {
+  last_frame_ = current_;
+  current_.page_reads.fill(0);
+  current_.page_writes.fill(0);
+  current_.ppu_reads.fill(0);
+  current_.ppu_writes.fill(0);
+  current_.io_reads.fill(0);
+  current_.io_writes.fill(0);
+  std::fill(current_.prg_bank_reads.begin(), current_.prg_bank_reads.end(), 0);
+}
+
+}  // namespace nes
@@ -0,0 +1,97 @@
+#ifndef NES_EMULATOR_BUS_BUS_STATS_H_
+#define NES_EMULATOR_BUS_BUS_STATS_H_
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace nes {
+
+struct Cartridge;
+
+// CPU bus accesses during one frame.
+struct BusHistogram {
+  // Per 256-byte page, so the RAM mirrors, PRG RAM and each PRG window
+  // show up separately.
+  std::array<uint32_t, 256> page_reads = {};
+  std::array<uint32_t, 256> page_writes = {};
+  // Per register: $2000-$2007 (and mirrors) and $4000-$401F.
+  std::array<uint32_t, 8> ppu_reads = {};
+  std::array<uint32_t, 8> ppu_writes = {};
+  std::array<uint32_t, 0x20> io_reads = {};
+  std::array<uint32_t, 0x20> io_writes = {};
+  // Reads from $8000-$FFFF per 8KB PRG ROM bank, whichever window it was
+  // mapped in.
+  std::vector<uint32_t> prg_bank_reads;
+
+  // One "frame,kind,index,reads,writes" line per non-zero bucket, kind
+  // being page, ppu, io or prg_bank.
+  void WriteCsv(std::ostream &out, uint64_t frame) const;
+};
+
+// Bus instrumentation policies. The Bus calls the hooks on every access;
+// which policy it uses is fixed at compile time (NES_BUS_STATS, the
+// bus-stats xmake option), so the default build pays nothing.
+
+// The default: every hook is empty.
+class NoBusStats {
+ public:
+  static constexpr bool kEnabled = false;
+
+  void Connect(const Cartridge &) {}
+  void CountRead(uint16_t, const uint8_t *) {}
+  void CountWrite(uint16_t) {}
+};
+
+// Counts accesses into a histogram until EndFrame().
+class BusStats {
+ public:
+  static constexpr bool kEnabled = true;
+
+  void Connect(const Cartridge &cartridge);
+
+  // host is the memory behind the address, nullptr for registers.
+  void CountRead(uint16_t address, const uint8_t *host) {
+    current_.page_reads[address >> 8]++;
+    if (address >= 0x8000) {
+      if (host >= prg_rom_ && host < prg_rom_end_) {
+        current_.prg_bank_reads[(host - prg_rom_) >> 13]++;
+      }
+    } else if (address >= 0x2000 && address < 0x4000) {
+      current_.ppu_reads[address & 0x07]++;
+    } else if (address >= 0x4000 && address < 0x4020) {
+      current_.io_reads[address & 0x1F]++;
+    }
+  }
+
+  void CountWrite(uint16_t address) {
+    current_.page_writes[address >> 8]++;
+    if (address >= 0x2000 && address < 0x4000) {
+      current_.ppu_writes[address & 0x07]++;
+    } else if (address >= 0x4000 && address < 0x4020) {
+      current_.io_writes[address & 0x1F]++;
+    }
+  }
+
+  // Finishes the frame: its histogram becomes last_frame() and counting
+  // starts over.
+  void EndFrame();
+  const BusHistogram &last_frame() const { return last_frame_; }
+
+ private:
+  BusHistogram current_;
+  BusHistogram last_frame_;
+  const uint8_t *prg_rom_ = nullptr;
+  const uint8_t *prg_rom_end_ = nullptr;
+};
+
+#ifdef NES_BUS_STATS
+using BusStatsPolicy = BusStats;
+#else
+using BusStatsPolicy = NoBusStats;
+#endif
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_BUS_BUS_STATS_H_
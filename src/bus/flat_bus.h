@@ -0,0 +1,49 @@
+#ifndef NES_EMULATOR_BUS_FLAT_BUS_H_
+#define NES_EMULATOR_BUS_FLAT_BUS_H_
+
+#include <array>
+#include <cstdint>
+
+namespace nes {
+
+// 64KB of plain RAM and nothing else, for running 6502 programs such as
+// the snake test without a console around them. Use it with FlatCpu.
+class FlatBus {
+ public:
+  static constexpr bool kHasOamDma = false;
+
+  // Every page is RAM and none is mirrored, see BasicCpu::Write().
+  static int CodePage(uint16_t address) { return address >> 8; }
+
+  explicit FlatBus(std::array<uint8_t, 0x10000> &memory) : memory_(memory) {}
+
+  void CpuWrite8Bit(uint16_t address, uint8_t value) {
+    memory_[address] = value;
+  }
+
+  void CpuWrite16Bit(uint16_t address, uint16_t value) {
+    CpuWrite8Bit(address, value);
+    CpuWrite8Bit(address + 1, value >> 8);
+  }
+
+  uint8_t CpuRead8Bit(uint16_t address) {
+    return memory_[address];
+  }
+
+  uint16_t CpuRead16Bit(uint16_t address) {
+    return CpuRead8Bit(address) | (CpuRead8Bit(address + 1) << 8);
+  }
+
+  const uint8_t *CpuReadPointer(uint16_t address) {
+    return &memory_[address];
+  }
+
+  bool irq() const { return false; }
+
+ private:
+  std::array<uint8_t, 0x10000> &memory_;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_BUS_FLAT_BUS_H_
@@ -1,70 +1,84 @@
 #include "cartridge.h"
 
+#include <algorithm>
+#include <filesystem>
 #include <format>
 #include <vector>
 #include <array>
 #include <string>
-#include <fstream>
 #include <cstdint>
 #include <iostream>
 
 namespace nes {
 
 bool Cartridge::LoadRomFile(const std::string &path) {
-  std::ifstream ifs;
-  ifs.open(path);
-
-  if (!ifs.is_open()) {
-    std::cerr << std::format("No such file: {}\n", path);
+  mapper.reset();
+  prg_rom = {};
+  chr_rom = {};
+  chr_ram.clear();
+  prg_ram = {};
+  prg_ram_buffer.clear();
+  save_ram.Close();
+
+  image = RomImage::Open(path);
+  if (image == nullptr) {
     return false;
   }
 
-  prg_rom.clear();
-  chr_rom.clear();
-
-  std::string content((std::istreambuf_iterator<char>(ifs)),
-                      std::istreambuf_iterator<char>());
+  std::span<const uint8_t, 16> header = image->header();
+  Flags6.raw = header[6];
+  Flags7.raw = header[7];
+  Flags8 = header[8];
+  mapper_number = image->mapper_number();
+
+  prg_rom = image->prg_rom();
+  chr_rom = image->chr_rom();
+
+  std::size_t prg_ram_size = 0;
+  if (image->nes2()) {
+    // See https://www.nesdev.org/wiki/NES_2.0
+    // RAM sizes are shift counts, 64 << n bytes or none for 0.
+    auto ram_size = [](int shift) { return shift != 0 ? 64 << shift : 0; };
+    prg_ram_size = ram_size(header[10] & 0x0F) + ram_size(header[10] >> 4);
+    if (chr_rom.empty()) {
+      chr_ram.resize(std::max(ram_size(header[11] & 0x0F), 8192));
+    }
+  } else {
+    if (chr_rom.empty()) {
+      chr_ram.resize(8192);
+    }
 
-  if (content.size() <= 16 ||
-      content[0] != 'N' || content[1] != 'E' || content[2] != 'S' ||
-      content[3] != 0x1A) {
-    std::cerr << std::format("Invalid rom format\n");
-    return false;
+    // iNES 1.0 only says whether PRG RAM is battery backed, but MMC1 and
+    // MMC3 boards nearly always have 8KB of it.
+    if (Flags6.PRG_RAM || mapper_number == 1 || mapper_number == 4) {
+      int chunk = 1;
+      if (Flags8 != 0) {
+        chunk = Flags8;
+      }
+      prg_ram_size = chunk * 8192;
+    }
   }
 
-  int prg_rom_size = content[4];
-  int chr_rom_size = content[5];
-
-  Flags6.raw = content[6];
-  Flags7.raw = content[7];
-  Flags8 = content[8];
-  mapper = (Flags7.MAPPER_NUMBER << 8) | Flags6.MAPPER_NUMBER;
-
-  // Skip header
-  int offset = 16;
-  if (Flags6.TRAINER) {
-    offset += 512;
+  // Flags6.PRG_RAM means the RAM is battery backed and keeps the game's
+  // saves. If the save file can't be used, e.g. another instance is
+  // running the same ROM, the game still runs, it just forgets.
+  bool battery = Flags6.PRG_RAM && prg_ram_size != 0;
+  if (battery &&
+      save_ram.Open(std::filesystem::path(path).replace_extension(".sav"),
+                    prg_ram_size)) {
+    prg_ram = std::span<uint8_t>(save_ram.data(), save_ram.size());
+  } else {
+    if (battery) {
+      std::cerr << std::format("Saves of {} will not be kept\n", path);
+    }
+    prg_ram_buffer.resize(prg_ram_size);
+    prg_ram = prg_ram_buffer;
   }
 
-  prg_rom.resize(prg_rom_size * 16384);
-  chr_rom.resize(chr_rom_size * 8192);
-
-  std::copy(content.begin() + offset,
-            content.begin() + offset + 16384 * prg_rom_size,
-            prg_rom.begin());
-
-  offset += 16384 * prg_rom_size;
-
-  std::copy(content.begin() + offset,
-            content.begin() + offset + 8192 * chr_rom_size,
-            chr_rom.begin());
-
-  if (Flags7.NES2_0 == 2) {
-    int chunk = 1;
-    if (Flags8 != 0) {
-      chunk = Flags8;
-    }
-    prg_ram.resize(chunk * 8192);
+  mapper = Mapper::Create(*this);
+  if (mapper == nullptr) {
+    std::cerr << std::format("Unsupported mapper: {}\n", mapper_number);
+    return false;
   }
 
   return true;
@@ -6,6 +6,12 @@
 #include <string>
 #include <cstdint>
 #include <format>
+#include <memory>
+#include <span>
+
+#include "cartridge/rom_image.h"
+#include "cartridge/save_ram.h"
+#include "mapper/mapper.h"
 
 namespace nes {
 
@@ -35,11 +41,22 @@ struct Cartridge {
 
   uint8_t Flags8;
 
-  int mapper;
+  int mapper_number;
+
+  // The ROM file, shared with every other Cartridge that loaded it. PRG
+  // and CHR ROM point into it.
+  std::shared_ptr<const RomImage> image;
+  std::span<const uint8_t> prg_rom;
+  std::span<const uint8_t> chr_rom;
+  std::vector<uint8_t> chr_ram;  // At least 8KB when the ROM has no CHR ROM.
+  // PRG RAM at $6000. Battery-backed RAM is save_ram, a mapping of the
+  // .sav file next to the ROM; otherwise it is prg_ram_buffer.
+  std::span<uint8_t> prg_ram;
+  std::vector<uint8_t> prg_ram_buffer;
+  SaveRam save_ram;
 
-  std::vector<uint8_t> prg_rom;
-  std::vector<uint8_t> chr_rom;
-  std::vector<uint8_t> prg_ram;
+  // Bank switching hardware, created by LoadRomFile().
+  std::unique_ptr<Mapper> mapper;
 
  public:
   bool LoadRomFile(const std::string &path);
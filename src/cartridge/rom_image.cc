@@ -0,0 +1,120 @@
+#include "rom_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <format>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace nes {
+
+namespace {
+
+// Identifies the file contents an image was mapped from.
+using ImageKey = std::tuple<dev_t, ino_t, off_t, time_t, long>;
+
+std::mutex cache_mutex;
+std::map<ImageKey, std::weak_ptr<const RomImage>> cache;
+
+// Size of a ROM area in bytes, 0 for a size that can't be right. NES 2.0
+// adds a high nibble to the size in units, or with $F switches to
+// 2^E * (M * 2 + 1) bytes. See https://www.nesdev.org/wiki/NES_2.0#PRG-ROM_Area
+std::size_t RomAreaSize(uint8_t lsb, uint8_t msb, std::size_t unit) {
+  if (msb != 0x0F) {
+    return ((msb << 8) | lsb) * unit;
+  }
+
+  int exponent = lsb >> 2;
+  if (exponent > 40) {
+    return 0;
+  }
+  return (std::size_t { 1 } << exponent) * ((lsb & 0x03) * 2 + 1);
+}
+
+}  // namespace
+
+std::shared_ptr<const RomImage> RomImage::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << std::format("No such file: {}\n", path);
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 16) {
+    close(fd);
+    std::cerr << std::format("Invalid rom format\n");
+    return nullptr;
+  }
+
+  ImageKey key { st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec };
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    if (std::shared_ptr<const RomImage> image = it->second.lock()) {
+      close(fd);
+      return image;
+    }
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << std::format("Cannot map: {}\n", path);
+    return nullptr;
+  }
+
+  std::shared_ptr<RomImage> image(
+      new RomImage(static_cast<const uint8_t *>(data), st.st_size));
+  if (!image->Parse(path)) {
+    return nullptr;
+  }
+
+  std::erase_if(cache, [](const auto &item) { return item.second.expired(); });
+  cache[key] = image;
+  return image;
+}
+
+RomImage::~RomImage() {
+  munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+bool RomImage::Parse(const std::string &path) {
+  if (data_[0] != 'N' || data_[1] != 'E' || data_[2] != 'S' ||
+      data_[3] != 0x1A) {
+    std::cerr << std::format("Invalid rom format\n");
+    return false;
+  }
+
+  uint8_t prg_msb = nes2() ? data_[9] & 0x0F : 0;
+  uint8_t chr_msb = nes2() ? data_[9] >> 4 : 0;
+  std::size_t prg_size = RomAreaSize(data_[4], prg_msb, 0x4000);
+  std::size_t chr_size = RomAreaSize(data_[5], chr_msb, 0x2000);
+
+  // Mappers switch PRG in 8KB units at least and the power-on layout
+  // mirrors 16KB, CHR in 1KB units.
+  if (prg_size == 0 || prg_size % 0x4000 != 0 || chr_size % 0x400 != 0) {
+    std::cerr << std::format("Invalid rom format\n");
+    return false;
+  }
+
+  // Skip the header and the trainer, if any.
+  std::size_t offset = (data_[6] & 0x04) ? 16 + 512 : 16;
+  if (offset + prg_size + chr_size > size_) {
+    std::cerr << std::format("Truncated rom: {} needs {} bytes, has {}\n",
+                             path, offset + prg_size + chr_size, size_);
+    return false;
+  }
+
+  prg_rom_ = std::span<const uint8_t>(data_ + offset, prg_size);
+  chr_rom_ = std::span<const uint8_t>(data_ + offset + prg_size, chr_size);
+  return true;
+}
+
+}  // namespace nes
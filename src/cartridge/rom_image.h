@@ -0,0 +1,58 @@
+#ifndef NES_EMULATOR_CARTRIDGE_ROM_IMAGE_H_
+#define NES_EMULATOR_CARTRIDGE_ROM_IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace nes {
+
+// An iNES / NES 2.0 file mapped read-only into memory. The header is
+// parsed in place and PRG and CHR ROM are spans into the mapping, so
+// nothing is copied. Images are immutable and shared: opening a file
+// that is already open (same device, inode, size and mtime) returns the
+// existing image, and the mapping goes away with its last user.
+//
+// See https://www.nesdev.org/wiki/INES and
+// https://www.nesdev.org/wiki/NES_2.0
+class RomImage {
+ public:
+  // nullptr, with the reason on stderr, if the file can't be mapped or
+  // its header asks for more data than the file has.
+  static std::shared_ptr<const RomImage> Open(const std::string &path);
+
+  ~RomImage();
+  RomImage(const RomImage &) = delete;
+  RomImage &operator=(const RomImage &) = delete;
+
+  std::span<const uint8_t, 16> header() const {
+    return std::span<const uint8_t, 16>(data_, 16);
+  }
+  bool nes2() const { return (data_[7] & 0x0C) == 0x08; }
+  // NES 2.0 adds mapper bits 8-11 and a submapper.
+  int mapper_number() const {
+    int number = (data_[7] & 0xF0) | (data_[6] >> 4);
+    return nes2() ? number | ((data_[8] & 0x0F) << 8) : number;
+  }
+  int submapper() const { return nes2() ? data_[8] >> 4 : 0; }
+
+  std::span<const uint8_t> prg_rom() const { return prg_rom_; }
+  std::span<const uint8_t> chr_rom() const { return chr_rom_; }
+
+ private:
+  RomImage(const uint8_t *data, std::size_t size) : data_(data), size_(size) {}
+
+  // Locates PRG and CHR ROM, false if they don't fit in the file.
+  bool Parse(const std::string &path);
+
+  const uint8_t *data_;
+  std::size_t size_;
+  std::span<const uint8_t> prg_rom_;
+  std::span<const uint8_t> chr_rom_;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_CARTRIDGE_ROM_IMAGE_H_
@@ -0,0 +1,109 @@
+#include "save_ram.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+
+namespace nes {
+
+SaveRam::~SaveRam() {
+  Close();
+}
+
+bool SaveRam::Open(const std::string &path, std::size_t size) {
+  Close();
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << std::format("Cannot open: {}\n", path);
+    return false;
+  }
+
+  // The mapping is the RAM itself, so two cartridges running the same ROM
+  // must not both map it. The lock lasts as long as fd_ stays open.
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    close(fd);
+    std::cerr << std::format("In use by another instance: {}\n", path);
+    return false;
+  }
+
+  // A new file reads as zeros, like RAM that was never written.
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (static_cast<std::size_t>(st.st_size) < size &&
+       ftruncate(fd, size) != 0)) {
+    close(fd);
+    std::cerr << std::format("Cannot resize: {}\n", path);
+    return false;
+  }
+
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    std::cerr << std::format("Cannot map: {}\n", path);
+    return false;
+  }
+
+  fd_ = fd;
+  data_ = static_cast<uint8_t *>(data);
+  size_ = size;
+  dirty_.assign(size / 0x100, false);
+  return true;
+}
+
+void SaveRam::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+
+  Flush(true);
+  munmap(data_, size_);
+  close(fd_);  // Releases the lock.
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+  dirty_.clear();
+}
+
+bool SaveRam::Flush(bool wait) {
+  // msync() works on whole host pages, so dirty 256-byte pages are
+  // merged into runs of host pages.
+  const std::size_t host_page = sysconf(_SC_PAGESIZE);
+  const std::size_t per_host_page = host_page / 0x100;
+  bool ok = true;
+
+  std::size_t run_start = 0;
+  std::size_t run_end = 0;
+  auto sync = [&]() {
+    if (run_end > run_start &&
+        msync(data_ + run_start, std::min(run_end, size_) - run_start,
+              wait ? MS_SYNC : MS_ASYNC) != 0) {
+      ok = false;
+    }
+  };
+
+  for (std::size_t page = 0; page < dirty_.size(); ++page) {
+    if (!dirty_[page]) {
+      continue;
+    }
+    dirty_[page] = false;
+
+    std::size_t start = page / per_host_page * host_page;
+    if (start > run_end) {
+      sync();
+      run_start = start;
+    }
+    run_end = start + host_page;
+  }
+  sync();
+
+  return ok;
+}
+
+}  // namespace nes
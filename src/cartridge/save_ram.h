@@ -0,0 +1,54 @@
+#ifndef NES_EMULATOR_CARTRIDGE_SAVE_RAM_H_
+#define NES_EMULATOR_CARTRIDGE_SAVE_RAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nes {
+
+// Battery-backed PRG RAM, a shared mapping of a .sav file. Stores to it
+// land in the page cache right away, so they survive the emulator
+// crashing; Flush() only has to get the written parts onto the disk.
+//
+// The file is locked while it is mapped: a second SaveRam, in this
+// process or another, fails to open it rather than share the RAM.
+//
+// Nothing watches the stores themselves. Whoever maps the RAM calls
+// MarkDirty() for a 256-byte page the first time it is written after a
+// flush (see Bus), so the hot path stays plain stores.
+class SaveRam {
+ public:
+  SaveRam() = default;
+  ~SaveRam();
+  SaveRam(const SaveRam &) = delete;
+  SaveRam &operator=(const SaveRam &) = delete;
+
+  // Maps size bytes of path, creating or growing the file as needed.
+  // Fails if another SaveRam has it open.
+  bool Open(const std::string &path, std::size_t size);
+  // Flushes everything and unmaps the file.
+  void Close();
+
+  bool is_open() const { return data_ != nullptr; }
+  uint8_t *data() { return data_; }
+  std::size_t size() const { return size_; }
+
+  void MarkDirty(int page) { dirty_[page] = true; }
+
+  // Writes the pages dirtied since the last flush back to the file. With
+  // wait false it only schedules the writeback, so it is cheap enough to
+  // call every so often while running.
+  bool Flush(bool wait);
+
+ private:
+  int fd_ = -1;  // Holds the lock.
+  uint8_t *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::vector<bool> dirty_;  // Per 256-byte page.
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_CARTRIDGE_SAVE_RAM_H_
@@ -1,108 +1,586 @@
 #include "cpu.h"
 
+#include <algorithm>
+#include <array>
 #include <format>
 #include <iostream>
 #include <cassert>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "bus/bus.h"
+#include "bus/flat_bus.h"
+#include "trace/trace.h"
 #include "utils/assert.h"
 
 namespace nes {
 
-Cpu::Cpu(Bus &bus) : bus_(bus) {
+namespace {
+
+// All official opcodes, indexed by opcode byte at compile time so dispatch
+// is a single array load instead of a map lookup.
+#define NES_OPCODE(name, mode, code, bytes, cycles, cycles_plus, func) \
+  typename BasicCpu<BusT>::Opcode { \
+    name, CpuBase::mode, code, bytes, cycles, cycles_plus, \
+    &BasicCpu<BusT>::template func<CpuBase::mode, cycles_plus> }
+
+template <typename BusT>
+constexpr typename BasicCpu<BusT>::Opcode kOpcodeList[] = {
+  NES_OPCODE("ADC", kImmediate,
+             0x69, 2, 2, false, ADC),
+  NES_OPCODE("ADC", kZeroPage,
+             0x65, 2, 3, false, ADC),
+  NES_OPCODE("ADC", kZeroPageX,
+             0x75, 2, 4, false, ADC),
+  NES_OPCODE("ADC", kAbsolute,
+             0x6D, 3, 4, false, ADC),
+  NES_OPCODE("ADC", kAbsoluteX,
+             0x7D, 3, 4, true, ADC),
+  NES_OPCODE("ADC", kAbsoluteY,
+             0x79, 3, 4, true, ADC),
+  NES_OPCODE("ADC", kIndexedIndirect,
+             0x61, 2, 6, false, ADC),
+  NES_OPCODE("ADC", kIndirectIndexed,
+             0x71, 2, 5, true, ADC),
+
+  NES_OPCODE("AND", kImmediate,
+             0x29, 2, 2, false, AND),
+  NES_OPCODE("AND", kZeroPage,
+             0x25, 2, 3, false, AND),
+  NES_OPCODE("AND", kZeroPageX,
+             0x35, 2, 4, false, AND),
+  NES_OPCODE("AND", kAbsolute,
+             0x2D, 3, 4, false, AND),
+  NES_OPCODE("AND", kAbsoluteX,
+             0x3D, 3, 4, true, AND),
+  NES_OPCODE("AND", kAbsoluteY,
+             0x39, 3, 4, true, AND),
+  NES_OPCODE("AND", kIndexedIndirect,
+             0x21, 2, 6, false, AND),
+  NES_OPCODE("AND", kIndirectIndexed,
+             0x31, 2, 5, true, AND),
+
+  NES_OPCODE("ASL", kImplicit,
+             0x0A, 1, 2, false, ASL),
+  NES_OPCODE("ASL", kZeroPage,
+             0x06, 2, 5, false, ASL),
+  NES_OPCODE("ASL", kZeroPageX,
+             0x16, 2, 6, false, ASL),
+  NES_OPCODE("ASL", kAbsolute,
+             0x0E, 3, 6, false, ASL),
+  NES_OPCODE("ASL", kAbsoluteX,
+             0x1E, 3, 7, false, ASL),
+
+  NES_OPCODE("BCC", kRelative,
+             0x90, 2, 2, true, BCC),
+  NES_OPCODE("BCS", kRelative,
+             0xB0, 2, 2, true, BCS),
+  NES_OPCODE("BEQ", kRelative,
+             0xF0, 2, 2, true, BEQ),
+  NES_OPCODE("BIT", kZeroPage,
+             0x24, 2, 3, false, BIT),
+  NES_OPCODE("BIT", kAbsolute,
+             0x2C, 3, 4, false, BIT),
+  NES_OPCODE("BMI", kRelative,
+             0x30, 2, 2, true, BMI),
+  NES_OPCODE("BNE", kRelative,
+             0xD0, 2, 2, true, BNE),
+  NES_OPCODE("BPL", kRelative,
+             0x10, 2, 2, true, BPL),
+  NES_OPCODE("BVC", kRelative,
+             0x50, 2, 2, true, BVC),
+  NES_OPCODE("BVS", kRelative,
+             0x70, 2, 2, true, BVS),
+  NES_OPCODE("BRK", kImplicit,
+             0x00, 2, 7, false, BRK),
+
+  NES_OPCODE("CLC", kImplicit,
+             0x18, 1, 2, false, CLC),
+  NES_OPCODE("CLD", kImplicit,
+             0xD8, 1, 2, false, CLD),
+  NES_OPCODE("CLI", kImplicit,
+             0x58, 1, 2, false, CLI),
+  NES_OPCODE("CLV", kImplicit,
+             0xB8, 1, 2, false, CLV),
+  NES_OPCODE("CMP", kImmediate,
+             0xC9, 2, 2, false, CMP),
+  NES_OPCODE("CMP", kZeroPage,
+             0xC5, 2, 3, false, CMP),
+  NES_OPCODE("CMP", kZeroPageX,
+             0xD5, 2, 4, false, CMP),
+  NES_OPCODE("CMP", kAbsolute,
+             0xCD, 3, 4, false, CMP),
+  NES_OPCODE("CMP", kAbsoluteX,
+             0xDD, 3, 4, true, CMP),
+  NES_OPCODE("CMP", kAbsoluteY,
+             0xD9, 3, 4, true, CMP),
+  NES_OPCODE("CMP", kIndexedIndirect,
+             0xC1, 2, 6, false, CMP),
+  NES_OPCODE("CMP", kIndirectIndexed,
+             0xD1, 2, 5, true, CMP),
+  NES_OPCODE("CPX", kImmediate,
+             0xE0, 2, 2, false, CPX),
+  NES_OPCODE("CPX", kZeroPage,
+             0xE4, 2, 3, false, CPX),
+  NES_OPCODE("CPX", kAbsolute,
+             0xEC, 3, 4, false, CPX),
+  NES_OPCODE("CPY", kImmediate,
+             0xC0, 2, 2, false, CPY),
+  NES_OPCODE("CPY", kZeroPage,
+             0xC4, 2, 3, false, CPY),
+  NES_OPCODE("CPY", kAbsolute,
+             0xCC, 3, 4, false, CPY),
+
+  NES_OPCODE("DEC", kZeroPage,
+             0xC6, 2, 5, false, DEC),
+  NES_OPCODE("DEC", kZeroPageX,
+             0xD6, 2, 6, false, DEC),
+  NES_OPCODE("DEC", kAbsolute,
+             0xCE, 3, 6, false, DEC),
+  NES_OPCODE("DEC", kAbsoluteX,
+             0xDE, 3, 7, false, DEC),
+  NES_OPCODE("DEX", kImplicit,
+             0xCA, 1, 2, false, DEX),
+  NES_OPCODE("DEY", kImplicit,
+             0x88, 1, 2, false, DEY),
+
+  NES_OPCODE("EOR", kImmediate,
+             0x49, 2, 2, false, EOR),
+  NES_OPCODE("EOR", kZeroPage,
+             0x45, 2, 3, false, EOR),
+  NES_OPCODE("EOR", kZeroPageX,
+             0x55, 2, 4, false, EOR),
+  NES_OPCODE("EOR", kAbsolute,
+             0x4D, 3, 4, false, EOR),
+  NES_OPCODE("EOR", kAbsoluteX,
+             0x5D, 3, 4, true, EOR),
+  NES_OPCODE("EOR", kAbsoluteY,
+             0x59, 3, 4, true, EOR),
+  NES_OPCODE("EOR", kIndexedIndirect,
+             0x41, 2, 6, false, EOR),
+  NES_OPCODE("EOR", kIndirectIndexed,
+             0x51, 2, 5, true, EOR),
+
+  NES_OPCODE("INC", kZeroPage,
+             0xE6, 2, 5, false, INC),
+  NES_OPCODE("INC", kZeroPageX,
+             0xF6, 2, 6, false, INC),
+  NES_OPCODE("INC", kAbsolute,
+             0xEE, 3, 6, false, INC),
+  NES_OPCODE("INC", kAbsoluteX,
+             0xFE, 3, 7, false, INC),
+  NES_OPCODE("INX", kImplicit,
+             0xE8, 1, 2, false, INX),
+  NES_OPCODE("INY", kImplicit,
+             0xC8, 1, 2, false, INY),
+
+  NES_OPCODE("JMP", kAbsolute,
+             0x4C, 3, 3, false, JMP),
+  NES_OPCODE("JMP", kIndirect,
+             0x6C, 3, 5, false, JMP),
+  NES_OPCODE("JSR", kAbsolute,
+             0x20, 3, 6, false, JSR),
+
+  NES_OPCODE("LDA", kImmediate,
+             0xA9, 2, 2, false, LDA),
+  NES_OPCODE("LDA", kZeroPage,
+             0xA5, 2, 3, false, LDA),
+  NES_OPCODE("LDA", kZeroPageX,
+             0xB5, 2, 4, false, LDA),
+  NES_OPCODE("LDA", kAbsolute,
+             0xAD, 3, 4, false, LDA),
+  NES_OPCODE("LDA", kAbsoluteX,
+             0xBD, 3, 4, true, LDA),
+  NES_OPCODE("LDA", kAbsoluteY,
+             0xB9, 3, 4, true, LDA),
+  NES_OPCODE("LDA", kIndexedIndirect,
+             0xA1, 2, 6, false, LDA),
+  NES_OPCODE("LDA", kIndirectIndexed,
+             0xB1, 2, 5, true, LDA),
+
+  NES_OPCODE("LDX", kImmediate,
+             0xA2, 2, 2, false, LDX),
+  NES_OPCODE("LDX", kZeroPage,
+             0xA6, 2, 3, false, LDX),
+  NES_OPCODE("LDX", kZeroPageY,
+             0xB6, 2, 4, false, LDX),
+  NES_OPCODE("LDX", kAbsolute,
+             0xAE, 3, 4, false, LDX),
+  NES_OPCODE("LDX", kAbsoluteY,
+             0xBE, 3, 4, true, LDX),
+
+  NES_OPCODE("LDY", kImmediate,
+             0xA0, 2, 2, false, LDY),
+  NES_OPCODE("LDY", kZeroPage,
+             0xA4, 2, 3, false, LDY),
+  NES_OPCODE("LDY", kZeroPageX,
+             0xB4, 2, 4, false, LDY),
+  NES_OPCODE("LDY", kAbsolute,
+             0xAC, 3, 4, false, LDY),
+  NES_OPCODE("LDY", kAbsoluteX,
+             0xBC, 3, 4, true, LDY),
+  NES_OPCODE("LSR", kImplicit,
+             0x4A, 1, 2, false, LSR),
+  NES_OPCODE("LSR", kZeroPage,
+             0x46, 2, 5, false, LSR),
+  NES_OPCODE("LSR", kZeroPageX,
+             0x56, 2, 6, false, LSR),
+  NES_OPCODE("LSR", kAbsolute,
+             0x4E, 3, 6, false, LSR),
+  NES_OPCODE("LSR", kAbsoluteX,
+             0x5E, 3, 7, false, LSR),
+
+  NES_OPCODE("NOP", kImplicit,
+             0xEA, 1, 2, false, NOP),
+
+  NES_OPCODE("ORA", kImmediate,
+             0x09, 2, 2, false, ORA),
+  NES_OPCODE("ORA", kZeroPage,
+             0x05, 2, 3, false, ORA),
+  NES_OPCODE("ORA", kZeroPageX,
+             0x15, 2, 4, false, ORA),
+  NES_OPCODE("ORA", kAbsolute,
+             0x0D, 3, 4, false, ORA),
+  NES_OPCODE("ORA", kAbsolute,
+             0x0D, 3, 4, false, ORA),
+  NES_OPCODE("ORA", kAbsoluteX,
+             0x1D, 3, 4, true, ORA),
+  NES_OPCODE("ORA", kAbsoluteY,
+             0x19, 3, 4, true, ORA),
+  NES_OPCODE("ORA", kIndexedIndirect,
+             0x01, 2, 6, false, ORA),
+  NES_OPCODE("ORA", kIndirectIndexed,
+             0x11, 2, 5, true, ORA),
+
+  NES_OPCODE("PHA", kImplicit,
+             0x48, 1, 3, false, PHA),
+  NES_OPCODE("PHP", kImplicit,
+             0x08, 1, 3, false, PHP),
+  NES_OPCODE("PLA", kImplicit,
+             0x68, 1, 4, false, PLA),
+  NES_OPCODE("PLP", kImplicit,
+             0x28, 1, 4, false, PLP),
+
+  NES_OPCODE("ROL", kImplicit,
+             0x2A, 1, 2, false, ROL),
+  NES_OPCODE("ROL", kZeroPage,
+             0x26, 2, 5, false, ROL),
+  NES_OPCODE("ROL", kZeroPageX,
+             0x36, 2, 6, false, ROL),
+  NES_OPCODE("ROL", kAbsolute,
+             0x2E, 3, 6, false, ROL),
+  NES_OPCODE("ROL", kAbsoluteX,
+             0x3E, 3, 7, false, ROL),
+  NES_OPCODE("ROR", kImplicit,
+             0x6A, 1, 2, false, ROR),
+  NES_OPCODE("ROR", kZeroPage,
+             0x66, 2, 5, false, ROR),
+  NES_OPCODE("ROR", kZeroPageX,
+             0x76, 2, 6, false, ROR),
+  NES_OPCODE("ROR", kAbsolute,
+             0x6E, 3, 6, false, ROR),
+  NES_OPCODE("ROR", kAbsoluteX,
+             0x7E, 3, 7, false, ROR),
+  NES_OPCODE("RTI", kImplicit,
+             0x40, 1, 6, false, RTI),
+  NES_OPCODE("RTS", kImplicit,
+             0x60, 1, 6, false, RTS),
+
+  NES_OPCODE("SBC", kImmediate,
+             0xE9, 2, 2, false, SBC),
+  NES_OPCODE("SBC", kZeroPage,
+             0xE5, 2, 3, false, SBC),
+  NES_OPCODE("SBC", kZeroPageX,
+             0xF5, 2, 4, false, SBC),
+  NES_OPCODE("SBC", kAbsolute,
+             0xED, 3, 4, false, SBC),
+  NES_OPCODE("SBC", kAbsoluteX,
+             0xFD, 3, 4, true, SBC),
+  NES_OPCODE("SBC", kAbsoluteY,
+             0xF9, 3, 4, true, SBC),
+  NES_OPCODE("SBC", kIndexedIndirect,
+             0xE1, 2, 6, false, SBC),
+  NES_OPCODE("SBC", kIndirectIndexed,
+             0xF1, 2, 5, true, SBC),
+  NES_OPCODE("STA", kZeroPage,
+             0x85, 2, 3, false, STA),
+  NES_OPCODE("STA", kZeroPageX,
+             0x95, 2, 4, false, STA),
+  NES_OPCODE("STA", kAbsolute,
+             0x8D, 3, 4, false, STA),
+  NES_OPCODE("STA", kAbsoluteX,
+             0x9D, 3, 5, false, STA),
+  NES_OPCODE("STA", kAbsoluteY,
+             0x99, 3, 5, false, STA),
+  NES_OPCODE("STA", kIndexedIndirect,
+             0x81, 2, 6, false, STA),
+  NES_OPCODE("STA", kIndirectIndexed,
+             0x91, 2, 6, false, STA),
+  NES_OPCODE("STX", kZeroPage,
+             0x86, 2, 3, false, STX),
+  NES_OPCODE("STX", kZeroPageY,
+             0x96, 2, 4, false, STX),
+  NES_OPCODE("STX", kAbsolute,
+             0x8E, 3, 4, false, STX),
+  NES_OPCODE("STY", kZeroPage,
+             0x84, 2, 3, false, STY),
+  NES_OPCODE("STY", kZeroPageX,
+             0x94, 2, 4, false, STY),
+  NES_OPCODE("STY", kAbsolute,
+             0x8C, 3, 4, false, STY),
+  NES_OPCODE("SEC", kImplicit,
+             0x38, 1, 2, false, SEC),
+  NES_OPCODE("SED", kImplicit,
+             0xF8, 1, 2, false, SED),
+  NES_OPCODE("SEI", kImplicit,
+             0x78, 1, 2, false, SEI),
+
+  NES_OPCODE("TAX", kImplicit,
+             0xAA, 1, 2, false, TAX),
+  NES_OPCODE("TAY", kImplicit,
+             0xA8, 1, 2, false, TAY),
+  NES_OPCODE("TSX", kImplicit,
+             0xBA, 1, 2, false, TSX),
+  NES_OPCODE("TXA", kImplicit,
+             0x8A, 1, 2, false, TXA),
+  NES_OPCODE("TXS", kImplicit,
+             0x9A, 1, 2, false, TXS),
+  NES_OPCODE("TYA", kImplicit,
+             0x98, 1, 2, false, TYA),
+};
+
+#undef NES_OPCODE
+
+template <typename BusT>
+constexpr std::array<typename BasicCpu<BusT>::Opcode, 256> MakeOpcodeTable() {
+  std::array<typename BasicCpu<BusT>::Opcode, 256> table{};
+  for (const auto &opcode_obj : kOpcodeList<BusT>) {
+    table[opcode_obj.opcode] = opcode_obj;
+  }
+  return table;
+}
+
+template <typename BusT>
+constexpr std::array<typename BasicCpu<BusT>::Opcode, 256> kOpcodes = MakeOpcodeTable<BusT>();
+
+}  // namespace
+
+template <typename BusT>
+BasicCpu<BusT>::BasicCpu(BusT &bus) : bus_(bus) {
   nmi_flipflop = false;
+  cycles = 0;
 }
 
-void Cpu::Tick() {
-  nes_assert(cycles == 0, std::format("Invalid cycles: {}", cycles));
+template <typename BusT>
+uint64_t BasicCpu<BusT>::Run(uint64_t cycle_budget) {
+  uint64_t start = cycles;
+  run_end_ = cycles + cycle_budget;
+
+  while (cycles < run_end_) {
+    Tick();
+    // Only the PPU can end an idle loop, so skip the passes up to the end
+    // of the budget and let the caller run the PPU, see Wake().
+    if (idle_) {
+      if (cycles < run_end_) {
+        uint64_t passes =
+            (run_end_ - cycles + idle_loop_cycles_ - 1) / idle_loop_cycles_;
+        cycles += passes * idle_loop_cycles_;
+        idle_cycles_ += passes * idle_loop_cycles_;
+      }
+      break;
+    }
+  }
+
+  return cycles - start;
+}
 
-  jumped_ = false;
+template <typename BusT>
+void BasicCpu<BusT>::ResumeIdle(uint64_t cycle) {
+  // Passes start every idle_loop_cycles_ from idle_start_.
+  cycle = std::max(cycle, idle_start_);
+  uint64_t passes = (cycles - cycle) / idle_loop_cycles_;
+  cycles -= passes * idle_loop_cycles_;
+  idle_cycles_ -= passes * idle_loop_cycles_;
+}
 
+template <typename BusT>
+void BasicCpu<BusT>::Tick() {
   // See https://www.nesdev.org/wiki/NMI
   if (nmi_flipflop) {
     NMI();
+    idle_ = false;
+  } else if (!p_.INTERRUPT_DISABLE && bus_.irq()) {
+    IRQ();
+    idle_ = false;
+  }
+
+  if (idle_) {
+    cycles += idle_loop_cycles_;
+    idle_cycles_ += idle_loop_cycles_;
+    return;
+  }
+
+  if (block_cache_enabled_) {
+    const Block *previous = last_block_;
+    const Block *block = LookupBlock();
+    last_block_ = block;
+    if (block != nullptr) {
+      // A loop that will go idle does so within a pass or two of being
+      // entered or woken. One still going after that is counting something
+      // down, and checking its registers every pass would only slow it.
+      if (block->loops) {
+        loop_passes_ = block == previous
+                           ? std::min(loop_passes_ + 1, kIdleCheckPasses)
+                           : 0;
+      }
+      if (block->loops && loop_passes_ < kIdleCheckPasses) {
+        RunLoopBlock(*block);
+      } else {
+        RunBlock(*block);
+      }
+      return;
+    }
   }
 
   // std::cout << std::format("PC: {:#x}\n", PC);
   // Fetch opcode
-  uint8_t opcode = bus_.CpuRead8Bit(PC);
+  const uint8_t *code = CodePointer(PC);
+  uint8_t opcode = code != nullptr ? code[0] : bus_.CpuRead8Bit(PC);
 
-  nes_assert(kOpcodes.find(opcode) != kOpcodes.end(),
+  const Opcode &opcode_obj = kOpcodes<BusT>[opcode];
+
+  nes_assert(opcode_obj.func != nullptr,
              std::format("Invalid opcode: 0x{:02x}, PC: 0x{:04x}", opcode, PC));
 
-  Opcode opcode_obj = kOpcodes.find(opcode)->second;
+  // Fetch operand
+  if (code != nullptr && (PC & 0xFF) + opcode_obj.bytes <= 0x100) {
+    if (opcode_obj.bytes == 2) {
+      operand_ = code[1];
+    } else if (opcode_obj.bytes == 3) {
+      operand_ = code[1] | (code[2] << 8);
+    }
+  } else if (opcode_obj.bytes == 2) {
+    operand_ = FetchByte(PC + 1);
+  } else if (opcode_obj.bytes == 3) {
+    operand_ = FetchWord(PC + 1);
+  }
 
-  cycles = opcode_obj.cycles;
+  Execute(opcode_obj.func, opcode_obj.bytes, opcode_obj.cycles);
+}
 
-  opcode_obj.func(opcode_obj);
+template <typename BusT>
+void BasicCpu<BusT>::Predecode(uint16_t address) {
+  // Follow the straight-line run, since blocks also split at page ends,
+  // I/O accesses and the length limit.
+  while (true) {
+    const uint8_t *code = bus_.CpuReadPointer(address);
+    if (code == nullptr || block_cache_.contains(code)) {
+      return;
+    }
 
-  if (!jumped_) {
-    PC += opcode_obj.bytes;
-  }
+    const Block *block = DecodeBlock(address, code);
+    if (block == nullptr || !block->falls_through) {
+      return;
+    }
 
-  if (interrupt_disable_delay_ > 0) {
-    interrupt_disable_delay_--;
-    if (interrupt_disable_delay_ == 0) {
-      P.INTERRUPT_DISABLE = interrupt_disable_latch_;
+    for (const DecodedOp &op : block->ops) {
+      address += op.bytes;
     }
   }
 }
 
-void Cpu::Reset() {
+template <typename BusT>
+const typename BasicCpu<BusT>::Opcode &BasicCpu<BusT>::LookupOpcode(uint8_t opcode) {
+  return kOpcodes<BusT>[opcode];
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::set_block_cache_enabled(bool enabled) {
+  block_cache_enabled_ = enabled;
+  block_cache_.clear();
+  code_pages_.reset();
+  last_block_ = nullptr;
+  idle_ = false;
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::Reset() {
   A = X = Y = 0;
   SP = 0XFF;
-  P.raw = 0;
-  P.B = 0;
-  P.INTERRUPT_DISABLE = 1;
-  P.UNUSED = 1;
+  set_status(0x24);  // INTERRUPT_DISABLE and UNUSED
 
   nmi_flipflop = false;
+  idle_ = false;
 
-  cycles = 0;
+  // The cartridge may have been (re)loaded since.
+  fetch_page_number_ = -1;
+  zero_page_ = bus_.CpuReadPointer(0x0000);
+
+  // cycles keeps running across resets, the PPU is synced to it.
 }
 
-std::string Cpu::Disassemble(uint16_t address) {
-  uint8_t opcode = bus_.CpuRead8Bit(address);
+template <typename BusT>
+CpuBase::Status BasicCpu<BusT>::status() const {
+  Status p = p_;
+  p.CARRY = carry_;
+  p.ZERO = (zero_result_ == 0);
+  p.OVERFLOW = overflow_;
+  p.NEGATIVE = (negative_result_ >> 7);
+  return p;
+}
 
-  nes_assert(kOpcodes.find(opcode) != kOpcodes.end(),
-             std::format("Invalid opcode: 0x{:02x}, PC: 0x{:04x}", opcode, PC));
+template <typename BusT>
+void BasicCpu<BusT>::set_status(uint8_t raw) {
+  p_.raw = raw;
+  carry_ = raw & 0x01;
+  zero_result_ = !(raw & 0x02);
+  overflow_ = (raw >> 6) & 0x01;
+  negative_result_ = raw;
+}
+
+template <typename BusT>
+std::string BasicCpu<BusT>::Disassemble(uint16_t address) {
+  uint8_t opcode = FetchByte(address);
 
-  Opcode opcode_obj = kOpcodes.find(opcode)->second;
+  const Opcode &opcode_obj = kOpcodes<BusT>[opcode];
+
+  nes_assert(opcode_obj.func != nullptr,
+             std::format("Invalid opcode: 0x{:02x}, PC: 0x{:04x}", opcode, PC));
 
   std::string right;
 
   switch (opcode_obj.addressing_mode) {
     case kAbsolute: {
-      right = std::format("${:04x}", bus_.CpuRead16Bit(address + 1));
+      right = std::format("${:04x}", FetchWord(address + 1));
       break;
     }
     case kZeroPage: {
-      right = std::format("${:02x}", bus_.CpuRead8Bit(address + 1));
+      right = std::format("${:02x}", FetchByte(address + 1));
       break;
     }
     case kZeroPageX: {
-      right = std::format("${:02x}, X", bus_.CpuRead8Bit(address + 1));
+      right = std::format("${:02x}, X", FetchByte(address + 1));
       break;
     }
     case kZeroPageY: {
-      right = std::format("${:02x}, Y", bus_.CpuRead8Bit(address + 1));
+      right = std::format("${:02x}, Y", FetchByte(address + 1));
       break;
     }
     case kAbsoluteX: {
-      right = std::format("${:04x}, X", bus_.CpuRead16Bit(address + 1));
+      right = std::format("${:04x}, X", FetchWord(address + 1));
       break;
     }
     case kAbsoluteY: {
-      right = std::format("${:04x}, Y", bus_.CpuRead16Bit(address + 1));
+      right = std::format("${:04x}, Y", FetchWord(address + 1));
       break;
     }
     case kImmediate: {
-      right = std::format("#${:02x}", bus_.CpuRead8Bit(address + 1));
+      right = std::format("#${:02x}", FetchByte(address + 1));
       break;
     }
     case kRelative: {
-      right = std::format("(${:02x})", bus_.CpuRead8Bit(address + 1));
+      right = std::format("(${:02x})", FetchByte(address + 1));
       break;
     }
     case kImplicit: {
@@ -110,15 +588,15 @@ std::string Cpu::Disassemble(uint16_t address) {
       break;
     }
     case kIndirect: {
-      right = std::format("(${:04x})", bus_.CpuRead16Bit(address + 1));
+      right = std::format("(${:04x})", FetchWord(address + 1));
       break;
     }
     case kIndexedIndirect: {
-      right = std::format("(${:02x}, X)", bus_.CpuRead8Bit(address + 1));
+      right = std::format("(${:02x}, X)", FetchByte(address + 1));
       break;
     }
     case kIndirectIndexed: {
-      right = std::format("(${:02x}), Y", bus_.CpuRead8Bit(address + 1));
+      right = std::format("(${:02x}), Y", FetchByte(address + 1));
       break;
     }
     default: {
@@ -131,11 +609,12 @@ std::string Cpu::Disassemble(uint16_t address) {
 }
 
 // Instructions
-void Cpu::ADC(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::ADC() {
   uint8_t pre_a = A;
-  uint8_t m = bus_.CpuRead8Bit(addr);
-  int16_t tmp_result = A + m + P.CARRY;
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
+  int16_t tmp_result = A + m + carry_;
   A = tmp_result;
 
   UpdateZeroAndNegativeFlag(A);
@@ -143,185 +622,220 @@ void Cpu::ADC(Opcode &opcode_obj) {
   UpdateCarryFlag(tmp_result);
 }
 
-void Cpu::AND(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
-  uint8_t m = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::AND() {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
 
   A &= m;
 
   UpdateZeroAndNegativeFlag(A);
 }
 
-void Cpu::ASL(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::ASL() {
   int16_t target;
-  AddressingMode addressing = opcode_obj.addressing_mode;
-  if (addressing == kImplicit) {
+  if constexpr (kMode == kImplicit) {
     target = A;
     target <<= 1;
     A = target;
   } else {
-    uint16_t addr = GetAddress(opcode_obj);
+    uint16_t addr = GetAddress<kMode, kCyclesPlus>();
     target = bus_.CpuRead8Bit(addr);
     target <<= 1;
-    bus_.CpuWrite8Bit(addr, target);
+    Write(addr, target);
   }
 
   UpdateZeroAndNegativeFlag(target);
   UpdateCarryFlag(target);
 }
 
-void Cpu::BCC(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.CARRY == 0));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BCC() {
+  BranchIf<kMode, kCyclesPlus>((carry_ == 0));
 }
 
-void Cpu::BCS(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.CARRY == 1));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BCS() {
+  BranchIf<kMode, kCyclesPlus>((carry_ == 1));
 }
 
-void Cpu::BEQ(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.ZERO == 1));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BEQ() {
+  BranchIf<kMode, kCyclesPlus>((zero_result_ == 0));
 }
 
-void Cpu::BIT(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
-
-  uint8_t m = bus_.CpuRead8Bit(addr);
-
-  uint8_t v = A & m;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BIT() {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
 
-  P.ZERO = (v == 0 ? 1 : 0);
-
-  Status tmp;
-  tmp.raw = m;
-
-  P.OVERFLOW = tmp.OVERFLOW;
-  P.NEGATIVE = tmp.NEGATIVE;
+  zero_result_ = A & m;
+  negative_result_ = m;
+  overflow_ = (m >> 6) & 0x1;
 }
 
-void Cpu::BMI(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.NEGATIVE == 1));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BMI() {
+  BranchIf<kMode, kCyclesPlus>((negative_result_ & 0x80) != 0);
 }
 
-void Cpu::BNE(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.ZERO == 0));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BNE() {
+  BranchIf<kMode, kCyclesPlus>((zero_result_ != 0));
 }
 
-void Cpu::BPL(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.NEGATIVE == 0));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BPL() {
+  BranchIf<kMode, kCyclesPlus>((negative_result_ & 0x80) == 0);
 }
 
-void Cpu::BVC(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.OVERFLOW == 0));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BVC() {
+  BranchIf<kMode, kCyclesPlus>((overflow_ == 0));
 }
 
-void Cpu::BVS(Opcode &opcode_obj) {
-  BranchIf(opcode_obj, (P.OVERFLOW == 1));
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BVS() {
+  BranchIf<kMode, kCyclesPlus>((overflow_ == 1));
 }
 
-void Cpu::BRK(Opcode &opcode_obj) {
-  (void) opcode_obj;
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BRK() {
   uint16_t new_pc = PC + 2;
   Push(new_pc >> 8);  // high bytes
   Push((new_pc & 0xFF));  // low bytes
-  Status tmp;
-  tmp = P;
+  Status tmp = status();
   tmp.B = 1;
   tmp.UNUSED = 1;
   Push(tmp.raw);
   PC = bus_.CpuRead16Bit(0xFFFE);
 
-  P.INTERRUPT_DISABLE = 1;
+  p_.INTERRUPT_DISABLE = 1;
 
   jumped_ = true;
 }
 
-void Cpu::CLC(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.CARRY = 0;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CLC() {
+  carry_ = 0;
 }
 
-void Cpu::CLD(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.DECIMAL = 0;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CLD() {
+  p_.DECIMAL = 0;
 }
 
-void Cpu::CLI(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.INTERRUPT_DISABLE = 0;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CLI() {
+  p_.INTERRUPT_DISABLE = 0;
+  // A pending IRQ is taken before the rest of the block.
+  block_invalidated_ = true;
 }
 
-void Cpu::CLV(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.OVERFLOW = 0;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CLV() {
+  overflow_ = 0;
 }
 
-void Cpu::CMP(Opcode &opcode_obj) {
-  Compare(opcode_obj, A);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CMP() {
+  Compare<kMode, kCyclesPlus>(A);
 }
 
-void Cpu::CPX(Opcode &opcode_obj) {
-  Compare(opcode_obj, X);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CPX() {
+  Compare<kMode, kCyclesPlus>(X);
 }
 
-void Cpu::CPY(Opcode &opcode_obj) {
-  Compare(opcode_obj, Y);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::CPY() {
+  Compare<kMode, kCyclesPlus>(Y);
 }
 
-void Cpu::DEC(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::DEC() {
+  uint16_t addr = GetAddress<kMode, kCyclesPlus>();
   uint8_t m = bus_.CpuRead8Bit(addr);
   Increment(&m, -1);
-  bus_.CpuWrite8Bit(addr, m);
+  Write(addr, m);
 }
 
-void Cpu::DEX(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::DEX() {
   Increment(&X, -1);
 }
 
-void Cpu::DEY(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::DEY() {
   Increment(&Y, -1);
 }
 
-void Cpu::EOR(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
-
-  uint8_t m = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::EOR() {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
 
   A ^= m;
 
   UpdateZeroAndNegativeFlag(A);
 }
 
-void Cpu::INC(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::INC() {
+  uint16_t addr = GetAddress<kMode, kCyclesPlus>();
   uint8_t m = bus_.CpuRead8Bit(addr);
   Increment(&m, 1);
-  bus_.CpuWrite8Bit(addr, m);
+  Write(addr, m);
 }
 
-void Cpu::INX(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::INX() {
   Increment(&X, 1);
 }
 
-void Cpu::INY(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::INY() {
   Increment(&Y, 1);
 }
 
-void Cpu::JMP(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::JMP() {
   /*
     Unfortunately, because of a CPU bug, if this 2-byte variable has an address ending in $FF and thus crosses a page, then the CPU fails to increment the page when reading the second byte and thus reads the wrong address. For example, JMP ($03FF) reads $03FF and $0300 instead of $0400. Care should be taken to ensure this variable does not cross a page.
    */
-  PC = GetAddress(opcode_obj);
+  PC = GetAddress<kMode, kCyclesPlus>();
   jumped_ = true;
 }
 
-void Cpu::JSR(Opcode &opcode_obj) {
-  uint16_t new_pc = GetAddress(opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::JSR() {
+  uint16_t new_pc = GetAddress<kMode, kCyclesPlus>();
   uint16_t next_pc = PC + 2;
 
   Push((next_pc >> 8));
@@ -332,47 +846,55 @@ void Cpu::JSR(Opcode &opcode_obj) {
   jumped_ = true;
 }
 
-void Cpu::LDA(Opcode &opcode_obj) {
-  LoadToReg(A, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::LDA() {
+  LoadToReg<kMode, kCyclesPlus>(A);
 }
 
-void Cpu::LDX(Opcode &opcode_obj) {
-  LoadToReg(X, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::LDX() {
+  LoadToReg<kMode, kCyclesPlus>(X);
 }
 
-void Cpu::LDY(Opcode &opcode_obj) {
-  LoadToReg(Y, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::LDY() {
+  LoadToReg<kMode, kCyclesPlus>(Y);
 }
 
-void Cpu::LSR(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::LSR() {
   uint8_t target;
 
   auto func = [this, &target](uint8_t *v){
-    P.CARRY = (*v & 0x01);
+    carry_ = (*v & 0x01);
     *v >>= 1;
     target = *v;
   };
 
-  if (opcode_obj.addressing_mode == kImplicit) {
+  if constexpr (kMode == kImplicit) {
     func(&A);
   } else {
-    uint16_t addr = GetAddress(opcode_obj);
+    uint16_t addr = GetAddress<kMode, kCyclesPlus>();
     uint8_t m = bus_.CpuRead8Bit(addr);
     func(&m);
-    bus_.CpuWrite8Bit(addr, m);
+    Write(addr, m);
   }
 
   UpdateZeroAndNegativeFlag(target);
 }
 
-void Cpu::NMI() {
+template <typename BusT>
+void BasicCpu<BusT>::NMI() {
   uint16_t new_pc = PC;
 
   Push(new_pc >> 8);  // high bytes
   Push((new_pc & 0xFF));  // low bytes
 
-  Status tmp;
-  tmp = P;
+  Status tmp = status();
   tmp.B = 1;
   tmp.UNUSED = 1;
   Push(tmp.raw);
@@ -380,103 +902,134 @@ void Cpu::NMI() {
   PC = bus_.CpuRead16Bit(0xFFFA);
   nmi_flipflop = false;
 
-  // P.INTERRUPT_DISABLE = 1;
+  // The handler starts with IRQs masked, or a pending mapper IRQ would
+  // preempt it on its first instruction.
+  p_.INTERRUPT_DISABLE = 1;
+  interrupt_disable_delay_ = 0;
+  cycles += 7;
 }
 
-void Cpu::NOP(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+void BasicCpu<BusT>::IRQ() {
+  Push(PC >> 8);  // high bytes
+  Push(PC & 0xFF);  // low bytes
+
+  Status tmp = status();
+  tmp.B = 0;
+  tmp.UNUSED = 1;
+  Push(tmp.raw);
+
+  PC = bus_.CpuRead16Bit(0xFFFE);
+  p_.INTERRUPT_DISABLE = 1;
+  interrupt_disable_delay_ = 0;
+  cycles += 7;
 }
 
-void Cpu::ORA(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
-  uint8_t m = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::NOP() {
+}
+
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::ORA() {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
   A |= m;
 
   UpdateZeroAndNegativeFlag(A);
 }
 
-void Cpu::PHA(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Not used
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::PHA() {
   Push(A);
 }
 
-void Cpu::PHP(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Not used
-  Status tmp = P;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::PHP() {
+  Status tmp = status();
   tmp.B = 1;
   tmp.UNUSED = 1;
   Push(tmp.raw);
 }
 
-void Cpu::PLA(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Not used
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::PLA() {
   A = Pop();
 
   UpdateZeroAndNegativeFlag(A);
 }
 
-void Cpu::PLP(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Not used
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::PLP() {
   Status tmp;
   tmp.raw = Pop();
 
-  P.CARRY = tmp.CARRY;
-  P.ZERO = tmp.ZERO;
+  carry_ = tmp.CARRY;
+  zero_result_ = !tmp.ZERO;
   // P.INTERRUPT_DISABLE = tmp.INTERRUPT_DISABLE; delayed 1 instruction.
   interrupt_disable_latch_ = tmp.INTERRUPT_DISABLE;
   interrupt_disable_delay_ = 2;
-  P.DECIMAL = tmp.DECIMAL;
-  P.OVERFLOW = tmp.OVERFLOW;
-  P.NEGATIVE = tmp.NEGATIVE;
+  p_.DECIMAL = tmp.DECIMAL;
+  overflow_ = tmp.OVERFLOW;
+  negative_result_ = tmp.raw;
 }
 
-void Cpu::ROL(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::ROL() {
   auto func = [this](uint8_t *v) {
     int16_t tmp = *v << 1;
-    tmp = (tmp & ~1) | (P.CARRY & 1);
-    P.CARRY = tmp >> 8;
+    tmp = (tmp & ~1) | (carry_ & 1);
+    carry_ = tmp >> 8;
     *v = tmp;
 
     UpdateZeroAndNegativeFlag(*v);
   };
 
-  if (opcode_obj.addressing_mode == kImplicit) {
+  if constexpr (kMode == kImplicit) {
     func(&A);
   } else {
-    uint16_t addr = GetAddress(opcode_obj);
+    uint16_t addr = GetAddress<kMode, kCyclesPlus>();
     uint8_t m = bus_.CpuRead8Bit(addr);
     func(&m);
-    bus_.CpuWrite8Bit(addr, m);
+    Write(addr, m);
   }
 }
 
-void Cpu::ROR(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::ROR() {
   auto func = [this](uint8_t *v) {
     uint8_t bit_zero = *v & 1;
     *v >>= 1;
-    *v |= (P.CARRY << 7);
-    P.CARRY = bit_zero;
+    *v |= (carry_ << 7);
+    carry_ = bit_zero;
 
     UpdateZeroAndNegativeFlag(*v);
   };
 
-  if (opcode_obj.addressing_mode == kImplicit) {
+  if constexpr (kMode == kImplicit) {
     func(&A);
   } else {
-    uint16_t addr = GetAddress(opcode_obj);
+    uint16_t addr = GetAddress<kMode, kCyclesPlus>();
     uint8_t m = bus_.CpuRead8Bit(addr);
     func(&m);
-    bus_.CpuWrite8Bit(addr, m);
+    Write(addr, m);
   }
 }
 
-void Cpu::RTI(Opcode &opcode_obj) {
-  (void) opcode_obj;
-
-  Status old = P;
-  P.raw = Pop();
-  P.UNUSED = old.UNUSED;
-  P.B = old.B;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::RTI() {
+  Status tmp;
+  tmp.raw = Pop();
+  tmp.UNUSED = p_.UNUSED;
+  tmp.B = p_.B;
+  set_status(tmp.raw);
 
   uint8_t low = Pop();
   uint8_t hi = Pop();
@@ -486,8 +1039,9 @@ void Cpu::RTI(Opcode &opcode_obj) {
   jumped_ = true;
 }
 
-void Cpu::RTS(Opcode &opcode_obj) {
-  (void) opcode_obj;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::RTS() {
   uint8_t low = Pop();
   uint8_t hi = Pop();
   uint16_t new_pc = ((hi << 8) | low);
@@ -496,181 +1050,164 @@ void Cpu::RTS(Opcode &opcode_obj) {
   jumped_ = true;
 }
 
-void Cpu::SEC(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.CARRY = 1;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::SEC() {
+  carry_ = 1;
 }
 
-void Cpu::SED(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.DECIMAL = 1;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::SED() {
+  p_.DECIMAL = 1;
 }
 
-void Cpu::SEI(Opcode &opcode_obj) {
-  (void) opcode_obj;
-  P.INTERRUPT_DISABLE = 1;
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::SEI() {
+  p_.INTERRUPT_DISABLE = 1;
 }
 
-void Cpu::STA(Opcode &opcode_obj) {
-  StoreToMem(A, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::STA() {
+  StoreToMem<kMode, kCyclesPlus>(A);
 }
 
-void Cpu::STX(Opcode &opcode_obj) {
-  StoreToMem(X, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::STX() {
+  StoreToMem<kMode, kCyclesPlus>(X);
 }
 
-void Cpu::STY(Opcode &opcode_obj) {
-  StoreToMem(Y, opcode_obj);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::STY() {
+  StoreToMem<kMode, kCyclesPlus>(Y);
 }
 
-void Cpu::SBC(Opcode &opcode_obj) {
-  uint16_t addr = GetAddress(opcode_obj);
-  uint8_t m = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::SBC() {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
 
   uint8_t pre_a = A;
-  int16_t result = A - m - ((~P.CARRY) & 0x01);
+  int16_t result = A - m - (carry_ ^ 0x01);
   A = result;
 
   UpdateZeroAndNegativeFlag(A);
   UpdateOverflowFlag(pre_a, ~m, A);
-  P.CARRY = ~static_cast<uint8_t>(result < 0x00);
+  carry_ = (result >= 0x00);
 }
 
-void Cpu::TAX(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TAX() {
   Transfer(A, X);
 }
 
-void Cpu::TAY(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TAY() {
   Transfer(A, Y);
 }
 
-void Cpu::TSX(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TSX() {
   Transfer(SP, X);
 }
 
-void Cpu::TXA(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TXA() {
   Transfer(X, A);
 }
 
-void Cpu::TXS(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TXS() {
   Transfer(X, SP, false);
 }
 
-void Cpu::TYA(Opcode &opcode_obj) {
-  (void) opcode_obj;  // Because we was implied
-
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::TYA() {
   Transfer(Y, A);
 }
 
-uint16_t Cpu::GetAddress(Opcode &opcode_obj) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+uint16_t BasicCpu<BusT>::GetAddress() {
   uint16_t result = 0;
 
-  AddressingMode addressing_mode = opcode_obj.addressing_mode;
-
-  switch (addressing_mode) {
-    case kImmediate: {
-      result = PC + 1;
-      break;
-    }
-    case kRelative: {
-      int8_t tmp = bus_.CpuRead8Bit(PC + 1);
-      result = PC + tmp;
-      break;
-    }
-    case kAbsolute: {
-      result = bus_.CpuRead16Bit(PC + 1);
-      break;
-    }
-    case kAbsoluteX: {
-      result = AbsoluteAdd(X, opcode_obj.cycles_plus);
-      break;
-    }
-    case kAbsoluteY: {
-      result = AbsoluteAdd(Y, opcode_obj.cycles_plus);
-      break;
+  if constexpr (kMode == kImmediate) {
+    result = PC + 1;
+  } else if constexpr (kMode == kRelative) {
+    int8_t tmp = operand_;
+    result = PC + tmp;
+  } else if constexpr (kMode == kAbsolute) {
+    result = operand_;
+  } else if constexpr (kMode == kAbsoluteX) {
+    result = AbsoluteAdd<kCyclesPlus>(X);
+  } else if constexpr (kMode == kAbsoluteY) {
+    result = AbsoluteAdd<kCyclesPlus>(Y);
+  } else if constexpr (kMode == kZeroPage) {
+    result = ZeroPageAdd(0);
+  } else if constexpr (kMode == kZeroPageX) {
+    result = ZeroPageAdd(X);
+  } else if constexpr (kMode == kZeroPageY) {
+    result = ZeroPageAdd(Y);
+  } else if constexpr (kMode == kIndirect) {
+    uint16_t addr = operand_;
+    uint8_t low = bus_.CpuRead8Bit(addr);
+    uint8_t hi;
+    if ((addr & 0xFF) == 0xFF) {
+      // See https://www.nesdev.org/wiki/Instruction_reference#JMP
+      hi = bus_.CpuRead8Bit((addr & 0xFF00));
+    } else {
+      hi = bus_.CpuRead8Bit(addr + 1);
     }
-    case kZeroPage: {
-      result = ZeroPageAdd(0);
-      break;
-    }
-    case kZeroPageX: {
-      result = ZeroPageAdd(X);
-      break;
-    }
-    case kZeroPageY: {
-      result = ZeroPageAdd(Y);
-      break;
-    }
-    case kIndirect: {
-      uint16_t addr = bus_.CpuRead16Bit(PC + 1);
-      uint8_t low = bus_.CpuRead8Bit(addr);
-      uint8_t hi;
-      if ((addr & 0xFF) == 0xFF) {
-        // See https://www.nesdev.org/wiki/Instruction_reference#JMP
-        hi = bus_.CpuRead8Bit((addr & 0xFF00));
-      } else {
-        hi = bus_.CpuRead8Bit(addr + 1);
-      }
-      result = (hi << 8) | low;
-      break;
-    }
-    case kIndexedIndirect: {
-      uint16_t addr = (PC + 1);
-      uint8_t tmp = bus_.CpuRead8Bit(addr);
+    result = (hi << 8) | low;
+  } else if constexpr (kMode == kIndexedIndirect) {
+    uint8_t tmp = operand_;
 
-      tmp += X;
+    tmp += X;
 
-      uint8_t low = bus_.CpuRead8Bit(tmp);
-      uint8_t hi;
+    uint8_t low = ReadZeroPage(tmp);
+    uint8_t hi;
 
-      if (tmp == 0xFF) {
-        hi = bus_.CpuRead8Bit(0x0);
-      } else {
-        hi = bus_.CpuRead8Bit(tmp + 1);
-      }
+    if (tmp == 0xFF) {
+      hi = ReadZeroPage(0x0);
+    } else {
+      hi = ReadZeroPage(tmp + 1);
+    }
 
-      result = (hi << 8) | low;
-      break;
+    result = (hi << 8) | low;
+  } else if constexpr (kMode == kIndirectIndexed) {
+    uint8_t zp_addr = operand_;
+    uint16_t indirect;
+    if (zp_addr == 0xFF) {
+      indirect = (ReadZeroPage(0x00) << 8) | ReadZeroPage(zp_addr);
+    } else {
+      indirect = ReadZeroPage(zp_addr) | (ReadZeroPage(zp_addr + 1) << 8);
     }
-    case kIndirectIndexed: {
-      uint16_t addr = (PC + 1);
-      uint8_t zp_addr = bus_.CpuRead8Bit(addr);
-      uint16_t indirect;
-      if (zp_addr == 0xFF) {
-        indirect = (bus_.CpuRead8Bit(0x00) << 8) | bus_.CpuRead8Bit(zp_addr);
-      } else {
-        uint8_t zp_addr = bus_.CpuRead8Bit(addr);
-        indirect = bus_.CpuRead16Bit(zp_addr);
-      }
 
-      result = indirect + Y;
+    result = indirect + Y;
 
-      if (opcode_obj.cycles_plus && IsCrossPage(indirect, result)) {
-        cycles++;
-      }
-      break;
+    if (kCyclesPlus && IsCrossPage(indirect, result)) {
+      cycles++;
     }
-    default:
-      std::string msg = std::format("No such mode: {}",
-                                    static_cast<int>(addressing_mode));
-      nes_assert(false, msg);
-      break;
+  } else {
+    // kImplicit has no operand address; no handler should ask for one.
+    static_assert(kMode != kImplicit, "Implicit addressing has no address");
   }
 
   return result;
 }
 
-bool Cpu::IsCrossPage(uint16_t old_address, uint16_t new_address) {
+template <typename BusT>
+bool BasicCpu<BusT>::IsCrossPage(uint16_t old_address, uint16_t new_address) {
   const int kPageSize = 256;
   if (old_address / kPageSize == new_address / kPageSize) {
     return false;
@@ -678,40 +1215,46 @@ bool Cpu::IsCrossPage(uint16_t old_address, uint16_t new_address) {
   return true;
 }
 
-uint16_t Cpu::AbsoluteAdd(uint8_t reg, bool cycles_plus) {
+template <typename BusT>
+template <bool kCyclesPlus>
+uint16_t BasicCpu<BusT>::AbsoluteAdd(uint8_t reg) {
   uint16_t result = 0;
 
-  uint16_t before = bus_.CpuRead16Bit(PC + 1);
+  uint16_t before = operand_;
   result = before + reg;
 
-  if (cycles_plus && IsCrossPage(before, result)) {
+  if (kCyclesPlus && IsCrossPage(before, result)) {
     cycles++;
   }
 
   return result;
 }
 
-uint16_t Cpu::ZeroPageAdd(uint8_t reg) {
-  uint16_t addr = (PC + 1);
-  uint8_t result = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+uint16_t BasicCpu<BusT>::ZeroPageAdd(uint8_t reg) {
+  uint8_t result = operand_;
   result += reg;
 
   return result;
 }
 
-void Cpu::LoadToReg(uint8_t &reg, Opcode &opcode_obj) {
-  uint16_t new_address = GetAddress(opcode_obj);
-  reg = bus_.CpuRead8Bit(new_address);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::LoadToReg(uint8_t &reg) {
+  reg = ReadOperand<kMode, kCyclesPlus>();
 
   UpdateZeroAndNegativeFlag(reg);
 }
 
-void Cpu::StoreToMem(uint8_t reg, Opcode &opcode_obj) {
-  uint16_t new_address = GetAddress(opcode_obj);
-  bus_.CpuWrite8Bit(new_address, reg);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::StoreToMem(uint8_t reg) {
+  uint16_t new_address = GetAddress<kMode, kCyclesPlus>();
+  Write(new_address, reg);
 }
 
-void Cpu::Transfer(uint8_t from, uint8_t &to, bool p) {
+template <typename BusT>
+void BasicCpu<BusT>::Transfer(uint8_t from, uint8_t &to, bool p) {
   to = from;
 
   if (p) {
@@ -719,70 +1262,415 @@ void Cpu::Transfer(uint8_t from, uint8_t &to, bool p) {
   }
 }
 
-void Cpu::UpdateZeroAndNegativeFlag(uint8_t v) {
-  int8_t result = v;
-  if (result == 0) {
-    P.ZERO = 1;
-  } else {
-    P.ZERO = 0;
-  }
-
-  if (result < 0) {
-    P.NEGATIVE = 1;
-  } else {
-    P.NEGATIVE = 0;
-  }
+template <typename BusT>
+void BasicCpu<BusT>::UpdateZeroAndNegativeFlag(uint8_t v) {
+  // Evaluated lazily, see status().
+  zero_result_ = v;
+  negative_result_ = v;
 }
 
-void Cpu::UpdateOverflowFlag(uint8_t a, uint8_t b, uint8_t result) {
+template <typename BusT>
+void BasicCpu<BusT>::UpdateOverflowFlag(uint8_t a, uint8_t b, uint8_t result) {
   // #See https://www.nesdev.org/wiki/Instruction_reference#ADC
-  P.OVERFLOW = ((result ^ a) & (result ^ b) & 0x80) != 0;
+  overflow_ = ((result ^ a) & (result ^ b) & 0x80) != 0;
 }
 
-void Cpu::UpdateCarryFlag(int16_t result) {
-  P.CARRY = 0;
-
-  if ((result >> 8) != 0) {
-    P.CARRY = 1;
-  }
+template <typename BusT>
+void BasicCpu<BusT>::UpdateCarryFlag(int16_t result) {
+  carry_ = (result >> 8) != 0;
 }
 
-void Cpu::BranchIf(Opcode &opcode_obj, bool condition) {
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::BranchIf(bool condition) {
   if (condition) {
     uint16_t old_pc = PC + 2;
-    PC = GetAddress(opcode_obj);
+    PC = GetAddress<kMode, kCyclesPlus>();
     cycles++;
 
-    if (opcode_obj.cycles_plus && IsCrossPage(old_pc, PC + 2)) {
+    if (kCyclesPlus && IsCrossPage(old_pc, PC + 2)) {
       cycles++;
     }
   }
 }
 
-void Cpu::Compare(Opcode &opcode_obj, uint8_t reg) {
-  uint16_t addr = GetAddress(opcode_obj);
-  uint8_t m = bus_.CpuRead8Bit(addr);
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+void BasicCpu<BusT>::Compare(uint8_t reg) {
+  uint8_t m = ReadOperand<kMode, kCyclesPlus>();
 
   uint8_t result = reg - m;
 
   UpdateZeroAndNegativeFlag(result);
-  P.CARRY = (reg >= m);
+  carry_ = (reg >= m);
 }
 
-void Cpu::Increment(uint8_t *target, int value) {
+template <typename BusT>
+void BasicCpu<BusT>::Increment(uint8_t *target, int value) {
   *target += value;
 
   UpdateZeroAndNegativeFlag(*target);
 }
 
-void Cpu::Push(uint8_t value) {
-  bus_.CpuWrite8Bit(0x100 + SP, value);
+template <typename BusT>
+void BasicCpu<BusT>::Push(uint8_t value) {
+  Write(0x100 + SP, value);
   SP--;
 }
 
-uint8_t Cpu::Pop() {
+template <typename BusT>
+uint8_t BasicCpu<BusT>::Pop() {
   SP++;
   return bus_.CpuRead8Bit(0x100 + SP);
 }
 
+template <typename BusT>
+template <CpuBase::AddressingMode kMode, bool kCyclesPlus>
+uint8_t BasicCpu<BusT>::ReadOperand() {
+  if constexpr (kMode == kImmediate) {
+    return operand_;
+  } else if constexpr (kMode == kZeroPage || kMode == kZeroPageX ||
+                       kMode == kZeroPageY) {
+    return ReadZeroPage(GetAddress<kMode, kCyclesPlus>());
+  } else {
+    return bus_.CpuRead8Bit(GetAddress<kMode, kCyclesPlus>());
+  }
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::Write(uint16_t address, uint8_t value) {
+  bus_.CpuWrite8Bit(address, value);
+
+  // Mapper registers, the write may have switched the bank PC is in. The
+  // rest of the running block may no longer be what is mapped at PC. (A
+  // scanline IRQ it moved is rescheduled by the bus.)
+  if (address >= 0x8000) {
+    fetch_page_number_ = -1;
+    block_invalidated_ = true;
+  }
+
+  // OAM DMA. The bus has already copied the page; the CPU is halted for
+  // 513 cycles, plus one to align to a read cycle if the write ended on an
+  // odd one. Charging them at once lets the PPU catch up over the stall in
+  // one batch; ending the block makes Run() notice a deadline the stall
+  // ran past, so e.g. vblank is handled right after it.
+  // See https://www.nesdev.org/wiki/DMA#OAM_DMA
+  if constexpr (BusT::kHasOamDma) {
+    if (address == 0x4014) {
+      cycles += 513 + (cycles & 1);
+      block_invalidated_ = true;
+    }
+  }
+
+  // Self-modifying code: drop every cached block decoded from this page.
+  int page = BusT::CodePage(address);
+  if (page >= 0 && code_pages_.test(page)) {
+    std::erase_if(block_cache_, [page](const auto &item) {
+      return item.second.page == page;
+    });
+    // Links may point at erased blocks, drop them all.
+    for (auto &item : block_cache_) {
+      item.second.links = {};
+    }
+    last_block_ = nullptr;
+    code_pages_.reset(page);
+    block_invalidated_ = true;
+  }
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::Execute(Handler func, uint8_t bytes, uint8_t op_cycles) {
+  if (trace_ != nullptr) [[unlikely]] {
+    TraceInstruction();
+  }
+
+  jumped_ = false;
+  instruction_start_ = cycles;
+  cycles += op_cycles;
+
+  (this->*func)();
+
+  if (!jumped_) {
+    PC += bytes;
+  }
+
+  if (interrupt_disable_delay_ > 0) {
+    interrupt_disable_delay_--;
+    if (interrupt_disable_delay_ == 0) {
+      p_.INTERRUPT_DISABLE = interrupt_disable_latch_;
+      block_invalidated_ = true;
+    }
+  }
+}
+
+// Out of line so that Execute(), which runs for every instruction, doesn't
+// carry the buffering code and the registers it needs.
+template <typename BusT>
+__attribute__((noinline, cold)) void BasicCpu<BusT>::TraceInstruction() {
+  trace_->Write(TraceRecord::Capture(*this));
+}
+
+template <typename BusT>
+const uint8_t *BasicCpu<BusT>::CodePointer(uint16_t address) {
+  if ((address >> 8) != fetch_page_number_) {
+    fetch_page_number_ = address >> 8;
+    fetch_page_ = bus_.CpuReadPointer(address & 0xFF00);
+  }
+  return fetch_page_ != nullptr ? fetch_page_ + (address & 0xFF) : nullptr;
+}
+
+template <typename BusT>
+uint8_t BasicCpu<BusT>::FetchByte(uint16_t address) {
+  const uint8_t *code = CodePointer(address);
+  return code != nullptr ? *code : bus_.CpuRead8Bit(address);
+}
+
+template <typename BusT>
+uint16_t BasicCpu<BusT>::FetchWord(uint16_t address) {
+  return FetchByte(address) | (FetchByte(address + 1) << 8);
+}
+
+template <typename BusT>
+uint8_t BasicCpu<BusT>::ReadZeroPage(uint8_t address) {
+  return zero_page_ != nullptr ? zero_page_[address] : bus_.CpuRead8Bit(address);
+}
+
+template <typename BusT>
+const typename BasicCpu<BusT>::Block *BasicCpu<BusT>::LookupBlock() {
+  const uint8_t *code = CodePointer(PC);
+  if (code == nullptr) {
+    return nullptr;
+  }
+
+  // Most blocks exit to one or two successors; follow the links from the
+  // block that just ran before falling back to the hash lookup.
+  if (last_block_ != nullptr) {
+    for (const typename Block::Link &link : last_block_->links) {
+      if (link.code == code) {
+        return link.block;
+      }
+    }
+  }
+
+  const Block *found = nullptr;
+  auto it = block_cache_.find(code);
+  if (it != block_cache_.end()) {
+    found = &it->second;
+  } else {
+    found = DecodeBlock(PC, code);
+  }
+
+  if (found != nullptr && last_block_ != nullptr) {
+    typename Block::Link &link = last_block_->links[last_block_->next_link];
+    link.code = code;
+    link.block = found;
+    last_block_->next_link ^= 1;
+  }
+
+  return found;
+}
+
+template <typename BusT>
+const typename BasicCpu<BusT>::Block *BasicCpu<BusT>::DecodeBlock(uint16_t address, const uint8_t *code) {
+  // Decode straight-line code until a control flow instruction, an I/O
+  // access or the end of the page. A page always maps to one contiguous
+  // host range, so the block stays valid as long as that memory does.
+  Block block;
+  block.page = BusT::CodePage(address);
+  bool idle_safe = true;
+  uint16_t last_address = address;
+
+  const uint8_t *page = code - (address & 0xFF);
+  unsigned offset = address & 0xFF;
+
+  while (block.ops.size() < kMaxBlockOps) {
+    const Opcode &opcode_obj = kOpcodes<BusT>[page[offset]];
+    if (opcode_obj.func == nullptr || offset + opcode_obj.bytes > 0x100) {
+      break;
+    }
+
+    uint16_t operand = 0;
+    if (opcode_obj.bytes == 2) {
+      operand = page[offset + 1];
+    } else if (opcode_obj.bytes == 3) {
+      operand = page[offset + 1] | (page[offset + 2] << 8);
+    }
+
+    // Only the first instruction of a block may touch I/O registers, so the
+    // caller has caught the PPU up before the access happens.
+    bool io = IsIoAccess(opcode_obj, operand);
+    if (io && !block.ops.empty()) {
+      break;
+    }
+    if (io && IsIdleSafe(opcode_obj, operand)) {
+      block.polls_status = true;
+    }
+    if (!EndsBlock(opcode_obj)) {
+      idle_safe = idle_safe && IsIdleSafe(opcode_obj, operand);
+    }
+
+    block.ops.push_back(DecodedOp { opcode_obj.func, operand,
+                                    opcode_obj.bytes,
+                                    static_cast<uint8_t>(opcode_obj.cycles) });
+    last_address = address + (offset - (address & 0xFF));
+    offset += opcode_obj.bytes;
+
+    if (EndsBlock(opcode_obj)) {
+      if (idle_safe) {
+        // The loop branch itself, e.g. BIT $2002 / BPL or JMP *.
+        if (opcode_obj.addressing_mode == kRelative) {
+          int8_t tmp = operand;
+          block.loops = static_cast<uint16_t>(last_address + 2 + tmp) == address;
+        } else if (opcode_obj.opcode == 0x4C) {
+          block.loops = operand == address;
+        }
+      }
+      switch (opcode_obj.opcode) {
+        case 0x00:  // BRK
+        case 0x4C:  // JMP
+        case 0x6C:  // JMP
+        case 0x40:  // RTI
+        case 0x60:  // RTS
+          block.falls_through = false;
+          break;
+      }
+      break;
+    }
+  }
+
+  if (block.ops.empty()) {
+    // Let the interpreter deal with it (and report invalid opcodes).
+    return nullptr;
+  }
+
+  if (block.page >= 0) {
+    code_pages_.set(block.page);
+  }
+
+  return &block_cache_.emplace(code, std::move(block)).first->second;
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::RunBlock(const Block &block) {
+  block_invalidated_ = false;
+
+  for (const DecodedOp &op : block.ops) {
+    operand_ = op.operand;
+    Execute(op.func, op.bytes, op.cycles);
+
+    // The block just overwrote its own code (and is gone), switched banks
+    // under itself, unmasked interrupts or stalled for OAM DMA.
+    if (block_invalidated_) {
+      break;
+    }
+  }
+}
+
+template <typename BusT>
+void BasicCpu<BusT>::RunLoopBlock(const Block &block) {
+  uint16_t start = PC;
+  uint64_t start_cycles = cycles;
+  IdleState before = SaveIdleState();
+  woken_ = false;
+
+  RunBlock(block);
+
+  // Back at the top with the same registers and nothing touched that the
+  // next pass would read, so every further pass is this one again.
+  if (PC == start && !woken_ && interrupt_disable_delay_ == 0 &&
+      SaveIdleState() == before) {
+    idle_ = true;
+    idle_polls_status_ = block.polls_status;
+    idle_start_ = cycles;
+    idle_loop_cycles_ = cycles - start_cycles;
+  }
+}
+
+template <typename BusT>
+typename BasicCpu<BusT>::IdleState BasicCpu<BusT>::SaveIdleState() const {
+  return IdleState { A, X, Y, SP, p_.raw,
+                     zero_result_, negative_result_, carry_, overflow_ };
+}
+
+template <typename BusT>
+bool BasicCpu<BusT>::EndsBlock(const Opcode &opcode_obj) {
+  if (opcode_obj.addressing_mode == kRelative) {
+    return true;
+  }
+
+  switch (opcode_obj.opcode) {
+    case 0x00:  // BRK
+    case 0x20:  // JSR
+    case 0x4C:  // JMP
+    case 0x6C:  // JMP
+    case 0x40:  // RTI
+    case 0x60:  // RTS
+    case 0x28:  // PLP, delayed interrupt disable
+    case 0x58:  // CLI
+    case 0x78:  // SEI
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename BusT>
+bool BasicCpu<BusT>::IsIoAccess(const Opcode &opcode_obj, uint16_t operand) {
+  switch (opcode_obj.addressing_mode) {
+    case kAbsolute:
+    case kAbsoluteX:
+    case kAbsoluteY:
+      // $2000-$401F: PPU and APU/joypad registers.
+      return operand >= 0x2000 && operand <= 0x401F;
+    case kIndirect:
+    case kIndexedIndirect:
+    case kIndirectIndexed:
+      // Target unknown until runtime, assume the worst.
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename BusT>
+bool BasicCpu<BusT>::IsIdleSafe(const Opcode &opcode_obj, uint16_t operand) {
+  // Instructions that never write memory. Register updates are fine, the
+  // loop only counts as idle if a whole pass leaves them unchanged.
+  static constexpr std::string_view kReadOnly[] = {
+    "ADC", "AND", "BIT", "CLC", "CLD", "CLV", "CMP", "CPX", "CPY",
+    "DEX", "DEY", "EOR", "INX", "INY", "LDA", "LDX", "LDY", "NOP",
+    "ORA", "SBC", "SEC", "SED", "TAX", "TAY", "TSX", "TXA", "TYA",
+  };
+  static constexpr std::string_view kShifts[] = { "ASL", "LSR", "ROL", "ROR" };
+
+  std::string_view name = opcode_obj.name;
+  if (std::find(std::begin(kShifts), std::end(kShifts), name) != std::end(kShifts)) {
+    return opcode_obj.addressing_mode == kImplicit;  // Accumulator only.
+  }
+  if (std::find(std::begin(kReadOnly), std::end(kReadOnly), name) == std::end(kReadOnly)) {
+    return false;
+  }
+
+  // Reads must come from memory that only the CPU can change, or from
+  // PPUSTATUS ($2002 and its mirrors), which wakes the CPU when it changes.
+  // Joypad and other registers change without telling us.
+  switch (opcode_obj.addressing_mode) {
+    case kAbsolute:
+      return operand <= 0x1FFF || (operand & 0xE007) == 0x2002 ||
+          operand >= 0x6000;
+    case kAbsoluteX:
+    case kAbsoluteY:
+      return operand + 0xFF <= 0x1FFF || operand >= 0x6000;
+    case kIndirect:
+    case kIndexedIndirect:
+    case kIndirectIndexed:
+      return false;
+    default:
+      return true;
+  }
+}
+
+template struct BasicCpu<Bus>;
+template struct BasicCpu<FlatBus>;
+
 }  // namespace nes
@@ -0,0 +1,233 @@
+#include "rom_index.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "cartridge/rom_image.h"
+
+namespace nes {
+
+namespace {
+
+constexpr char kMagic[4] = { 'N', 'I', 'D', 'X' };
+constexpr uint32_t kVersion = 1;
+
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t strings_size;
+};
+
+static_assert(sizeof(IndexHeader) == 16, "IndexHeader is a file format");
+
+// Reflected CRC-32 (polynomial $EDB88320), one table lookup per byte.
+constexpr std::array<uint32_t, 256> MakeCrcTable() {
+  std::array<uint32_t, 256> table {};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> kCrcTable = MakeCrcTable();
+
+}  // namespace
+
+uint32_t Crc32(std::span<const uint8_t> data, uint32_t crc) {
+  crc = ~crc;
+  for (uint8_t byte : data) {
+    crc = kCrcTable[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint64_t ContentHash(std::span<const uint8_t> data, uint64_t hash) {
+  constexpr uint64_t kMultiplier = 0x9E3779B97F4A7C15;
+
+  auto mix = [&hash](uint64_t word) {
+    hash = (hash ^ word) * kMultiplier;
+    hash ^= hash >> 32;
+  };
+
+  std::size_t i = 0;
+  for (; i + 8 <= data.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data.data() + i, 8);
+    mix(word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data.data() + i, data.size() - i);
+  mix(tail ^ data.size());
+
+  hash ^= hash >> 29;
+  hash *= 0xBF58476D1CE4E5B9;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+bool StatRomFile(const std::string &path, RomIndexEntry *entry) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    std::cerr << std::format("No such file: {}\n", path);
+    return false;
+  }
+
+  entry->file_size = st.st_size;
+  entry->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  return true;
+}
+
+bool IndexRomFile(const std::string &path, RomIndexEntry *entry) {
+  RomIndexEntry result;
+  if (!StatRomFile(path, &result)) {
+    return false;
+  }
+
+  std::shared_ptr<const RomImage> image = RomImage::Open(path);
+  if (image == nullptr) {
+    return false;
+  }
+
+  // See https://www.nesdev.org/wiki/INES#Flags_6
+  std::span<const uint8_t, 16> header = image->header();
+  result.prg_rom_size = image->prg_rom().size();
+  result.chr_rom_size = image->chr_rom().size();
+  result.mapper = image->mapper_number();
+  result.submapper = image->submapper();
+  result.flags = ((header[6] & 0x01) ? RomIndexEntry::kVerticalMirroring : 0) |
+                 ((header[6] & 0x02) ? RomIndexEntry::kBattery : 0) |
+                 ((header[6] & 0x04) ? RomIndexEntry::kTrainer : 0) |
+                 ((header[6] & 0x08) ? RomIndexEntry::kFourScreen : 0) |
+                 (image->nes2() ? RomIndexEntry::kNes2 : 0);
+
+  // PRG and CHR ROM are contiguous in the file.
+  std::span<const uint8_t> contents(image->prg_rom().data(),
+                                    image->prg_rom().size() +
+                                        image->chr_rom().size());
+  result.content_hash = ContentHash(contents);
+  result.crc32 = Crc32(contents);
+
+  *entry = result;
+  return true;
+}
+
+RomIndex::~RomIndex() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+bool RomIndex::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << std::format("Cannot open: {}\n", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(IndexHeader)) {
+    close(fd);
+    std::cerr << std::format("Invalid index: {}\n", path);
+    return false;
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << std::format("Cannot map: {}\n", path);
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(data);
+  size_ = st.st_size;
+
+  IndexHeader header;
+  std::memcpy(&header, data_, sizeof(header));
+  std::size_t entries_end =
+      sizeof(header) + std::size_t { header.entry_count } * sizeof(RomIndexEntry);
+  if (!std::equal(header.magic, header.magic + 4, kMagic) ||
+      header.version != kVersion ||
+      entries_end + header.strings_size != size_) {
+    std::cerr << std::format("Invalid index: {}\n", path);
+    return false;
+  }
+
+  entries_ = std::span<const RomIndexEntry>(
+      reinterpret_cast<const RomIndexEntry *>(data_ + sizeof(header)),
+      header.entry_count);
+  strings_ = reinterpret_cast<const char *>(data_ + entries_end);
+  for (const RomIndexEntry &entry : entries_) {
+    if (std::size_t { entry.path_offset } + entry.path_length >
+        header.strings_size) {
+      std::cerr << std::format("Invalid index: {}\n", path);
+      entries_ = {};
+      return false;
+    }
+  }
+  return true;
+}
+
+const RomIndexEntry *RomIndex::Find(std::string_view path) const {
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), path,
+      [this](const RomIndexEntry &entry, std::string_view key) {
+        return this->path(entry) < key;
+      });
+  if (it == entries_.end() || this->path(*it) != path) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+bool RomIndex::Write(
+    const std::string &path,
+    std::vector<std::pair<std::string, RomIndexEntry>> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::string strings;
+  for (auto &[name, entry] : entries) {
+    entry.path_offset = strings.size();
+    entry.path_length = name.size();
+    strings += name;
+  }
+
+  IndexHeader header;
+  std::copy(kMagic, kMagic + 4, header.magic);
+  header.version = kVersion;
+  header.entry_count = entries.size();
+  header.strings_size = strings.size();
+
+  std::string tmp_path = path + ".tmp";
+  std::ofstream ofs(tmp_path, std::ios::binary);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto &[name, entry] : entries) {
+    ofs.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+  }
+  ofs.write(strings.data(), strings.size());
+  ofs.close();
+
+  if (ofs.fail() || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << std::format("Cannot write: {}\n", path);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace nes
@@ -0,0 +1,88 @@
+#ifndef NES_EMULATOR_INDEX_ROM_INDEX_H_
+#define NES_EMULATOR_INDEX_ROM_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace nes {
+
+// One ROM file of a library, as nes-index found it. Entries are written
+// as-is (little-endian), so an index can be mapped and read in place.
+struct RomIndexEntry {
+  enum Flags : uint8_t {
+    kVerticalMirroring = 1 << 0,
+    kBattery = 1 << 1,
+    kTrainer = 1 << 2,
+    kFourScreen = 1 << 3,
+    kNes2 = 1 << 4,
+  };
+
+  // Over PRG and CHR ROM only, so re-headered dumps still match. The
+  // CRC32 is the one ROM databases (No-Intro, GoodNES) list.
+  uint64_t content_hash = 0;
+  // What the entry was made from. A rescan only reads files whose size
+  // or mtime changed.
+  uint64_t file_size = 0;
+  int64_t mtime_ns = 0;
+  uint32_t crc32 = 0;
+  uint32_t path_offset = 0;  // Into the string table.
+  uint32_t prg_rom_size = 0;
+  uint32_t chr_rom_size = 0;
+  uint16_t path_length = 0;
+  uint16_t mapper = 0;
+  uint8_t submapper = 0;
+  uint8_t flags = 0;
+  uint8_t reserved[2] = {};
+};
+
+static_assert(sizeof(RomIndexEntry) == 48, "RomIndexEntry is a file format");
+
+// Fills in file_size and mtime_ns only, to tell whether an indexed file
+// changed.
+bool StatRomFile(const std::string &path, RomIndexEntry *entry);
+// Reads the header of the ROM at path and hashes its contents. The path
+// fields are left for RomIndex::Write() to fill in.
+bool IndexRomFile(const std::string &path, RomIndexEntry *entry);
+
+uint32_t Crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+// 64-bit multiply-xorshift hash, eight bytes at a time.
+uint64_t ContentHash(std::span<const uint8_t> data, uint64_t hash = 0);
+
+// A read-only mapping of an index file: a header, the entries sorted by
+// path and the string table holding the paths.
+class RomIndex {
+ public:
+  RomIndex() = default;
+  ~RomIndex();
+  RomIndex(const RomIndex &) = delete;
+  RomIndex &operator=(const RomIndex &) = delete;
+
+  bool Open(const std::string &path);
+
+  std::span<const RomIndexEntry> entries() const { return entries_; }
+  std::string_view path(const RomIndexEntry &entry) const {
+    return std::string_view(strings_ + entry.path_offset, entry.path_length);
+  }
+  // nullptr if path isn't in the index.
+  const RomIndexEntry *Find(std::string_view path) const;
+
+  // Writes entries, sorted by path, to a temporary file and renames it
+  // over path, so readers that have the old index mapped are unaffected.
+  static bool Write(const std::string &path,
+                    std::vector<std::pair<std::string, RomIndexEntry>> entries);
+
+ private:
+  const uint8_t *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::span<const RomIndexEntry> entries_;
+  const char *strings_ = nullptr;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_INDEX_ROM_INDEX_H_
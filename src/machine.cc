@@ -1,16 +1,20 @@
 #include "machine.h"
 
 #include <chrono>
+#include <format>
 #include <iostream>
 
 #include "raylib.h"
 
+#include "aot/code_map.h"
+
 namespace nes {
 
 Machine::Machine(const std::string &path)
     : bus_(),
       cpu_(bus_),
-      ppu_(cpu_, cartridge_),
+      scheduler_(cpu_),
+      ppu_(cpu_, cartridge_, scheduler_),
       rom_path_(path) {
 }
 
@@ -23,16 +27,48 @@ int Machine::Run() {
   SetWindowMinSize(kSW, kSH);
   SetWindowMaxSize(kSW, kSH);
 
-  bus_.Connect(memory_, cartridge_, ppu_, joypad_);
-
   if (!cartridge_.LoadRomFile(rom_path_)) {
     return -1;
   }
 
+  bus_.Connect(memory_, cartridge_, ppu_, joypad_);
+
   // See https://www.nesdev.org/wiki/CPU_power_up_state
   cpu_.Reset();
   cpu_.PC = bus_.CpuRead16Bit(0xFFFC);
   cpu_.SP = 0xFD;
+  cpu_.set_block_cache_enabled(true);
+  ppu_.set_scanline_renderer_enabled(true);
+
+  if (!trace_path_.empty()) {
+    if (!trace_.Open(trace_path_)) {
+      return -1;
+    }
+    cpu_.set_trace(&trace_);
+  }
+
+  if (!bus_stats_path_.empty()) {
+    if (!BusStatsPolicy::kEnabled) {
+      std::cerr << "Bus stats need a build with NES_BUS_STATS "
+                   "(xmake f --bus-stats=y)\n";
+      return -1;
+    }
+    bus_stats_.open(bus_stats_path_);
+    if (!bus_stats_.is_open()) {
+      std::cerr << std::format("Cannot write: {}\n", bus_stats_path_);
+      return -1;
+    }
+    bus_stats_ << "frame,kind,index,reads,writes\n";
+  }
+
+  // Warm the block cache from an offline code map, if nes-aot made one.
+  CodeMap code_map;
+  if (code_map.Load(rom_path_ + ".aot") &&
+      code_map.rom_hash == CodeMap::HashPrgRom(cartridge_)) {
+    for (uint16_t entry : code_map.entries) {
+      cpu_.Predecode(entry);
+    }
+  }
 
   Image image = GenImageColor(256, 240, WHITE);
 
@@ -95,21 +131,40 @@ int Machine::Run() {
       joypad_.SetKey(Joypad::kB, false);
     }
 
-    bool out = false;
-    while (!out) {
-      cpu_.Tick();
-      int cycles = cpu_.cycles;
-      while (--cpu_.cycles > 0);
+    if (IsKeyPressed(KEY_F1)) {
+      show_stats_ = !show_stats_;
+    }
+
+    uint64_t idle_cycles = cpu_.idle_cycles();
+
+    // Run the CPU up to the next scheduled event (vblank, a scanline IRQ,
+    // the frame end), then let the PPU catch up, which handles it and
+    // posts the next ones. It syncs itself whenever the CPU touches its
+    // registers.
+    uint64_t frame = ppu_.frame();
+    while (ppu_.frame() == frame) {
+      cpu_.Run(scheduler_.CyclesToDeadline());
+      ppu_.CatchUp(cpu_.cycles);
+    }
+
+    // CPU cycles this frame spent in idle loops the CPU didn't interpret.
+    idle_cycles = cpu_.idle_cycles() - idle_cycles;
+
+    // Battery-backed RAM is already in the page cache; about once a
+    // second, schedule what changed for the disk.
+    if (frame % 60 == 0) {
+      bus_.FlushSaveRam(false);
+    }
 
-      for (int i = 0; i < 3 * cycles; ++i) {
-        ppu_.Tick();
-        if (ppu_.one_frame_finished()) {
-          out = true;
-        }
-      }
+#ifdef NES_BUS_STATS
+    bus_.stats().EndFrame();
+    if (bus_stats_.is_open()) {
+      bus_.stats().last_frame().WriteCsv(bus_stats_, frame);
     }
+#endif
 
-    UpdateTexture(texture, ppu_.pixels().data());
+    ppu_.frame_buffer().ToRgba(colors_.data());
+    UpdateTexture(texture, colors_.data());
 
     BeginDrawing();
     ClearBackground(GRAY);
@@ -121,6 +176,12 @@ int Machine::Run() {
                    0.0,
                    WHITE);
 
+    if (show_stats_) {
+      DrawFPS(8, 8);
+      DrawText(std::format("idle: {} cycles", idle_cycles).c_str(),
+               8, 32, 20, WHITE);
+    }
+
     // ppu_.TestRenderNametable(0x2000);
     // ppu_.TestRenderSprite();
     // ppu_.TestPalettes();
@@ -129,17 +190,36 @@ int Machine::Run() {
 
   UnloadTexture(texture);
   UnloadImage(image);
+
+  if (!bus_.FlushSaveRam(true)) {
+    std::cerr << std::format("Cannot write saves of: {}\n", rom_path_);
+    return -1;
+  }
   return 0;
 }
 
 }  // namespace nes
 
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: nes-emulator xxx.nes\n";
+  constexpr char kUsage[] =
+      "Usage: nes-emulator xxx.nes [--trace out.trace] "
+      "[--bus-stats out.csv]\n";
+  if (argc < 2 || argc % 2 != 0) {
+    std::cerr << kUsage;
     return 0;
   }
 
   nes::Machine m(argv[1]);
+  for (int i = 2; i < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--trace") {
+      m.set_trace_path(argv[i + 1]);
+    } else if (option == "--bus-stats") {
+      m.set_bus_stats_path(argv[i + 1]);
+    } else {
+      std::cerr << kUsage;
+      return 0;
+    }
+  }
   return m.Run();
 }
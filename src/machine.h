@@ -1,11 +1,14 @@
 #include <array>
+#include <fstream>
 #include <string>
 
 #include "bus/bus.h"
 #include "cpu/cpu.h"
 #include "ppu/ppu.h"
+#include "scheduler/scheduler.h"
 #include "cartridge/cartridge.h"
 #include "joypad/joypad.h"
+#include "trace/trace.h"
 
 namespace nes {
 
@@ -15,15 +18,30 @@ class Machine {
 
   int Run();
 
+  // Writes a binary trace of every instruction to path (see nes-trace).
+  void set_trace_path(const std::string &path) { trace_path_ = path; }
+  // Writes per-frame bus access histograms to path, see bus/bus_stats.h.
+  // Only builds with NES_BUS_STATS count accesses.
+  void set_bus_stats_path(const std::string &path) { bus_stats_path_ = path; }
+
  private:
   std::array<uint8_t, 0x0800> memory_;
   Cartridge cartridge_;
   Joypad joypad_;
   Bus bus_;
   Cpu cpu_;
+  Scheduler scheduler_;
   PPU ppu_;
+  // The PPU's frame converted for the window texture.
+  std::array<uint32_t, FrameBuffer::kWidth * FrameBuffer::kHeight> colors_;
 
   std::string rom_path_;
+  std::string trace_path_;
+  TraceWriter trace_;
+  std::string bus_stats_path_;
+  std::ofstream bus_stats_;
+
+  bool show_stats_ = false;  // F1: FPS and idle-skipped cycles per frame.
 };
 
 }  // namespace nes
@@ -0,0 +1,26 @@
+#ifndef NES_EMULATOR_MAPPER_AXROM_H_
+#define NES_EMULATOR_MAPPER_AXROM_H_
+
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 7, see https://www.nesdev.org/wiki/AxROM
+// Switchable 32KB PRG bank and single-screen mirroring, CHR RAM.
+class Axrom : public Mapper {
+ public:
+  explicit Axrom(Cartridge &cartridge) : Mapper(cartridge) {
+    SetMirroring(kSingleScreenLow);
+  }
+
+  void Write(uint16_t, uint8_t value) override {
+    MapPrg32K(value & 0x07);
+    SetMirroring(value & 0x10 ? kSingleScreenHigh : kSingleScreenLow);
+  }
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_AXROM_H_
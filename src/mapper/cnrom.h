@@ -0,0 +1,21 @@
+#ifndef NES_EMULATOR_MAPPER_CNROM_H_
+#define NES_EMULATOR_MAPPER_CNROM_H_
+
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 3, see https://www.nesdev.org/wiki/CNROM
+// Fixed PRG like NROM, switchable 8KB CHR bank.
+class Cnrom : public Mapper {
+ public:
+  explicit Cnrom(Cartridge &cartridge) : Mapper(cartridge) {}
+
+  void Write(uint16_t, uint8_t value) override { MapChr8K(value); }
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_CNROM_H_
@@ -0,0 +1,114 @@
+#include "mapper.h"
+
+#include <memory>
+
+#include "cartridge/cartridge.h"
+#include "mapper/axrom.h"
+#include "mapper/cnrom.h"
+#include "mapper/mmc1.h"
+#include "mapper/mmc3.h"
+#include "mapper/nrom.h"
+#include "mapper/uxrom.h"
+
+namespace nes {
+
+namespace {
+
+int Wrap(int bank, int count) {
+  bank %= count;
+  return bank < 0 ? bank + count : bank;
+}
+
+}  // namespace
+
+std::unique_ptr<Mapper> Mapper::Create(Cartridge &cartridge) {
+  switch (cartridge.mapper_number) {
+    case 0:
+      return std::make_unique<Nrom>(cartridge);
+    case 1:
+      return std::make_unique<Mmc1>(cartridge);
+    case 2:
+      return std::make_unique<Uxrom>(cartridge);
+    case 3:
+      return std::make_unique<Cnrom>(cartridge);
+    case 4:
+      return std::make_unique<Mmc3>(cartridge);
+    case 7:
+      return std::make_unique<Axrom>(cartridge);
+    default:
+      return nullptr;
+  }
+}
+
+Mapper::Mapper(Cartridge &cartridge) : cartridge_(cartridge) {
+  chr_writable_ = cartridge_.chr_rom.empty();
+  chr_data_ = chr_writable_ ? cartridge_.chr_ram.data()
+                            : cartridge_.chr_rom.data();
+  chr_1k_banks_ = (chr_writable_ ? cartridge_.chr_ram.size()
+                                 : cartridge_.chr_rom.size()) / 0x400;
+
+  // Power-on layout: the first 32KB and 8KB, iNES header mirroring.
+  // Boards override whatever their registers start out selecting.
+  MapPrg32K(0);
+  MapChr8K(0);
+  SetMirroring(cartridge_.Flags6.NAMETABLE_ARRANGEMENT ? kVertical
+                                                        : kHorizontal);
+}
+
+void Mapper::MapPrg8K(int slot, int bank) {
+  const uint8_t *window =
+      cartridge_.prg_rom.data() +
+      Wrap(bank, cartridge_.prg_rom.size() / 0x2000) * 0x2000;
+  if (prg_[slot] != window) {
+    prg_[slot] = window;
+    changed_prg_ |= 1 << slot;
+  }
+}
+
+void Mapper::MapPrg16K(int slot, int bank) {
+  // Wrapping to the 16KB bank count mirrors a 16KB ROM into $C000.
+  int count = cartridge_.prg_rom.size() / 0x4000;
+  bank = Wrap(bank, count);
+  MapPrg8K(slot * 2, bank * 2);
+  MapPrg8K(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::MapPrg32K(int bank) {
+  MapPrg16K(0, bank * 2);
+  MapPrg16K(1, bank * 2 + 1);
+}
+
+void Mapper::MapChr1K(int slot, int bank) {
+  chr_[slot] = chr_data_ + Wrap(bank, chr_1k_banks_) * 0x400;
+}
+
+void Mapper::MapChr4K(int slot, int bank) {
+  for (int i = 0; i < 4; ++i) {
+    MapChr1K(slot * 4 + i, bank * 4 + i);
+  }
+}
+
+void Mapper::MapChr8K(int bank) {
+  for (int i = 0; i < 8; ++i) {
+    MapChr1K(i, bank * 8 + i);
+  }
+}
+
+void Mapper::SetMirroring(Mirroring mirroring) {
+  switch (mirroring) {
+    case kHorizontal:
+      nametables_ = { 0, 0, 1, 1 };
+      break;
+    case kVertical:
+      nametables_ = { 0, 1, 0, 1 };
+      break;
+    case kSingleScreenLow:
+      nametables_ = { 0, 0, 0, 0 };
+      break;
+    case kSingleScreenHigh:
+      nametables_ = { 1, 1, 1, 1 };
+      break;
+  }
+}
+
+}  // namespace nes
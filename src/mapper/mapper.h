@@ -0,0 +1,104 @@
+#ifndef NES_EMULATOR_MAPPER_MAPPER_H_
+#define NES_EMULATOR_MAPPER_MAPPER_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace nes {
+
+struct Cartridge;
+
+// See https://www.nesdev.org/wiki/Mapper
+//
+// A mapper owns the bank windows of a cartridge as host pointers: four 8KB
+// PRG ROM windows at $8000/$A000/$C000/$E000 and eight 1KB CHR windows at
+// $0000-$1FFF. Register writes repoint windows; reads index a window and
+// never do bank arithmetic. The Bus mirrors the PRG windows in its page
+// table and picks up the changed ones after each register write.
+class Mapper {
+ public:
+  // Nametable arrangement, see https://www.nesdev.org/wiki/Mirroring
+  enum Mirroring {
+    kHorizontal = 0,
+    kVertical,
+    kSingleScreenLow,
+    kSingleScreenHigh,
+  };
+
+  // The board for cartridge.mapper_number, nullptr if it isn't supported.
+  static std::unique_ptr<Mapper> Create(Cartridge &cartridge);
+
+  explicit Mapper(Cartridge &cartridge);
+  virtual ~Mapper() = default;
+
+  // CPU writes to $8000-$FFFF.
+  virtual void Write(uint16_t address, uint8_t value) = 0;
+
+  const uint8_t *prg_window(int slot) const { return prg_[slot]; }
+  const uint8_t *chr_window(int slot) const { return chr_[slot]; }
+
+  // Returns the PRG windows repointed since the last call, one bit per slot.
+  uint8_t TakeChangedPrgWindows() {
+    uint8_t changed = changed_prg_;
+    changed_prg_ = 0;
+    return changed;
+  }
+
+  uint8_t ReadChr(uint16_t address) const {
+    return chr_[address >> 10][address & 0x3FF];
+  }
+
+  // Ignored unless the cartridge has CHR RAM. CHR ROM is the read-only
+  // ROM image, so windows are only written through when they point into
+  // the cartridge's chr_ram.
+  void WriteChr(uint16_t address, uint8_t value) {
+    if (chr_writable_) {
+      const_cast<uint8_t *>(chr_[address >> 10])[address & 0x3FF] = value;
+    }
+  }
+
+  // Which of the PPU's two 1KB nametables backs $2000, $2400, $2800 and
+  // $2C00.
+  int nametable(int index) const { return nametables_[index]; }
+
+  // Whether the mapper is pulling the CPU's IRQ line low.
+  bool irq() const { return irq_; }
+
+  // Scanline counters (MMC3) watch PPU address line A12. The PPU only
+  // reports rising edges to mappers that ask for them.
+  bool watches_a12() const { return watches_a12_; }
+  virtual void NotifyA12Rise() {}
+  // How many more rising edges until the mapper raises an IRQ, or -1 if
+  // it won't. Lets the CPU run ahead up to the IRQ instead of stopping
+  // every scanline.
+  virtual int A12RisesUntilIrq() const { return -1; }
+
+ protected:
+  // Bank numbers wrap around the ROM size, so -1 is the last bank.
+  void MapPrg8K(int slot, int bank);
+  void MapPrg16K(int slot, int bank);
+  void MapPrg32K(int bank);
+  void MapChr1K(int slot, int bank);
+  void MapChr4K(int slot, int bank);
+  void MapChr8K(int bank);
+  void SetMirroring(Mirroring mirroring);
+
+  Cartridge &cartridge_;
+  bool irq_ = false;
+  bool watches_a12_ = false;
+
+ private:
+  std::array<const uint8_t *, 4> prg_ = {};
+  std::array<const uint8_t *, 8> chr_;
+  std::array<int, 4> nametables_;
+  uint8_t changed_prg_ = 0;
+
+  const uint8_t *chr_data_;
+  int chr_1k_banks_;
+  bool chr_writable_;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_MAPPER_H_
@@ -0,0 +1,89 @@
+#include "mmc1.h"
+
+#include <cstdint>
+
+#include "cartridge/cartridge.h"
+
+namespace nes {
+
+Mmc1::Mmc1(Cartridge &cartridge) : Mapper(cartridge) {
+  UpdateBanks();
+}
+
+void Mmc1::Write(uint16_t address, uint8_t value) {
+  // Bit 7 resets the shift register and locks the last PRG bank at $C000.
+  if (value & 0x80) {
+    shift_ = 0;
+    shift_count_ = 0;
+    control_ |= 0x0C;
+    UpdateBanks();
+    return;
+  }
+
+  shift_ |= (value & 0x01) << shift_count_;
+  if (++shift_count_ < 5) {
+    return;
+  }
+
+  // The fifth write picks the register with address bits 13 and 14.
+  switch ((address >> 13) & 0x03) {
+    case 0:
+      control_ = shift_;
+      break;
+    case 1:
+      chr_bank0_ = shift_;
+      break;
+    case 2:
+      chr_bank1_ = shift_;
+      break;
+    case 3:
+      prg_bank_ = shift_;
+      break;
+  }
+  shift_ = 0;
+  shift_count_ = 0;
+  UpdateBanks();
+}
+
+void Mmc1::UpdateBanks() {
+  static constexpr Mirroring kMirroring[4] = {
+    kSingleScreenLow, kSingleScreenHigh, kVertical, kHorizontal,
+  };
+  SetMirroring(kMirroring[control_ & 0x03]);
+
+  // SUROM and friends: 512KB of PRG ROM, CHR bank bit 4 picks the 256KB
+  // half. See https://www.nesdev.org/wiki/MMC1#SxROM_connection_variants
+  int outer = 0;
+  if (cartridge_.prg_rom.size() > 0x40000) {
+    outer = chr_bank0_ & 0x10;
+  }
+  int bank = outer | (prg_bank_ & 0x0F);
+
+  switch ((control_ >> 2) & 0x03) {
+    case 0:
+    case 1:
+      // 32KB at $8000, the low bit is ignored.
+      MapPrg16K(0, bank & ~1);
+      MapPrg16K(1, bank | 1);
+      break;
+    case 2:
+      // First bank fixed at $8000, switch $C000.
+      MapPrg16K(0, outer);
+      MapPrg16K(1, bank);
+      break;
+    case 3:
+      // Switch $8000, last bank fixed at $C000.
+      MapPrg16K(0, bank);
+      MapPrg16K(1, outer | 0x0F);
+      break;
+  }
+
+  if (control_ & 0x10) {
+    MapChr4K(0, chr_bank0_);
+    MapChr4K(1, chr_bank1_);
+  } else {
+    MapChr8K(chr_bank0_ >> 1);
+  }
+}
+
+}  // namespace nes
@@ -0,0 +1,34 @@
+#ifndef NES_EMULATOR_MAPPER_MMC1_H_
+#define NES_EMULATOR_MAPPER_MMC1_H_
+
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 1, see https://www.nesdev.org/wiki/MMC1
+// Registers are loaded one bit per write through a 5-bit shift register.
+class Mmc1 : public Mapper {
+ public:
+  explicit Mmc1(Cartridge &cartridge);
+
+  void Write(uint16_t address, uint8_t value) override;
+
+ private:
+  // Repoints every window from the four registers.
+  void UpdateBanks();
+
+  uint8_t shift_ = 0;
+  int shift_count_ = 0;
+
+  // See https://www.nesdev.org/wiki/MMC1#Control_(internal,_$8000-$9FFF)
+  uint8_t control_ = 0x0C;
+  uint8_t chr_bank0_ = 0;
+  uint8_t chr_bank1_ = 0;
+  uint8_t prg_bank_ = 0;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_MMC1_H_
@@ -0,0 +1,99 @@
+#include "mmc3.h"
+
+#include <cstdint>
+
+#include "cartridge/cartridge.h"
+
+namespace nes {
+
+Mmc3::Mmc3(Cartridge &cartridge) : Mapper(cartridge) {
+  watches_a12_ = true;
+  UpdateBanks();
+}
+
+void Mmc3::Write(uint16_t address, uint8_t value) {
+  // Registers are selected by the address range and whether it is even.
+  bool odd = address & 0x01;
+  switch (address & 0xE000) {
+    case 0x8000:
+      if (odd) {
+        registers_[bank_select_ & 0x07] = value;
+      } else {
+        bank_select_ = value;
+      }
+      UpdateBanks();
+      break;
+    case 0xA000:
+      // Odd is PRG RAM protect, which we don't emulate. Four-screen boards
+      // ignore the mirroring bit.
+      if (!odd && !cartridge_.Flags6.ALTERNATIVE_NAMETABLE) {
+        SetMirroring(value & 0x01 ? kHorizontal : kVertical);
+      }
+      break;
+    case 0xC000:
+      if (odd) {
+        irq_counter_ = 0;
+        irq_reload_ = true;
+      } else {
+        irq_latch_ = value;
+      }
+      break;
+    case 0xE000:
+      irq_enabled_ = odd;
+      if (!odd) {
+        irq_ = false;  // Acknowledge.
+      }
+      break;
+  }
+}
+
+void Mmc3::NotifyA12Rise() {
+  // See https://www.nesdev.org/wiki/MMC3#IRQ_Specifics
+  if (irq_counter_ == 0 || irq_reload_) {
+    irq_counter_ = irq_latch_;
+    irq_reload_ = false;
+  } else {
+    irq_counter_--;
+  }
+
+  if (irq_counter_ == 0 && irq_enabled_) {
+    irq_ = true;
+  }
+}
+
+int Mmc3::A12RisesUntilIrq() const {
+  if (!irq_enabled_ || irq_) {
+    return -1;
+  }
+  if (irq_counter_ == 0 || irq_reload_) {
+    // The next edge reloads; a zero latch fires right away.
+    return irq_latch_ + 1;
+  }
+  return irq_counter_;
+}
+
+void Mmc3::UpdateBanks() {
+  // Bit 6 swaps $8000 and $C000, the other one is the second last bank.
+  if (bank_select_ & 0x40) {
+    MapPrg8K(0, -2);
+    MapPrg8K(2, registers_[6]);
+  } else {
+    MapPrg8K(0, registers_[6]);
+    MapPrg8K(2, -2);
+  }
+  MapPrg8K(1, registers_[7]);
+  MapPrg8K(3, -1);
+
+  // Bit 7 swaps the 2KB and 1KB halves of the pattern tables.
+  int big = (bank_select_ & 0x80) ? 4 : 0;
+  int small = big ^ 4;
+  MapChr1K(big + 0, registers_[0] & 0xFE);
+  MapChr1K(big + 1, registers_[0] | 0x01);
+  MapChr1K(big + 2, registers_[1] & 0xFE);
+  MapChr1K(big + 3, registers_[1] | 0x01);
+  for (int i = 0; i < 4; ++i) {
+    MapChr1K(small + i, registers_[2 + i]);
+  }
+}
+
+}  // namespace nes
@@ -0,0 +1,38 @@
+#ifndef NES_EMULATOR_MAPPER_MMC3_H_
+#define NES_EMULATOR_MAPPER_MMC3_H_
+
+#include <array>
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 4, see https://www.nesdev.org/wiki/MMC3
+// 8KB PRG and 1KB/2KB CHR banks, and a scanline counter clocked by PPU A12
+// that raises an IRQ when it reaches zero.
+class Mmc3 : public Mapper {
+ public:
+  explicit Mmc3(Cartridge &cartridge);
+
+  void Write(uint16_t address, uint8_t value) override;
+
+  void NotifyA12Rise() override;
+  int A12RisesUntilIrq() const override;
+
+ private:
+  void UpdateBanks();
+
+  uint8_t bank_select_ = 0;
+  // R0-R7, see https://www.nesdev.org/wiki/MMC3#Bank_data_($8001-$9FFF,_odd)
+  std::array<uint8_t, 8> registers_ = { 0, 2, 4, 5, 6, 7, 0, 1 };
+
+  uint8_t irq_latch_ = 0;
+  uint8_t irq_counter_ = 0;
+  bool irq_reload_ = false;
+  bool irq_enabled_ = false;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_MMC3_H_
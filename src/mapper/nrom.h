@@ -0,0 +1,21 @@
+#ifndef NES_EMULATOR_MAPPER_NROM_H_
+#define NES_EMULATOR_MAPPER_NROM_H_
+
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 0, see https://www.nesdev.org/wiki/NROM
+// No registers: 16KB or 32KB PRG ROM and 8KB CHR.
+class Nrom : public Mapper {
+ public:
+  explicit Nrom(Cartridge &cartridge) : Mapper(cartridge) {}
+
+  void Write(uint16_t, uint8_t) override {}
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_NROM_H_
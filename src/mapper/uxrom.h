@@ -0,0 +1,23 @@
+#ifndef NES_EMULATOR_MAPPER_UXROM_H_
+#define NES_EMULATOR_MAPPER_UXROM_H_
+
+#include <cstdint>
+
+#include "mapper/mapper.h"
+
+namespace nes {
+
+// Mapper 2, see https://www.nesdev.org/wiki/UxROM
+// Switchable 16KB PRG bank at $8000, last bank fixed at $C000.
+class Uxrom : public Mapper {
+ public:
+  explicit Uxrom(Cartridge &cartridge) : Mapper(cartridge) {
+    MapPrg16K(1, -1);
+  }
+
+  void Write(uint16_t, uint8_t value) override { MapPrg16K(0, value); }
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_MAPPER_UXROM_H_
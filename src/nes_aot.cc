@@ -0,0 +1,33 @@
+#include <format>
+#include <iostream>
+#include <string>
+
+#include "aot/code_map.h"
+#include "cartridge/cartridge.h"
+
+// Offline pass over a mapper 0 ROM: finds the code reachable from the
+// interrupt vectors and writes it to <rom>.aot, which nes-emulator picks
+// up to pre-decode its block cache.
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: nes-aot xxx.nes [output.aot]\n";
+    return -1;
+  }
+
+  std::string rom_path = argv[1];
+  std::string out_path = argc > 2 ? argv[2] : rom_path + ".aot";
+
+  nes::Cartridge cartridge;
+  if (!cartridge.LoadRomFile(rom_path)) {
+    return -1;
+  }
+
+  nes::CodeMap map;
+  if (!map.Analyze(cartridge) || !map.Save(out_path)) {
+    return -1;
+  }
+
+  std::cout << std::format("{}: {} entry points, hash {:016x}\n",
+                           out_path, map.entries.size(), map.rom_hash);
+  return 0;
+}
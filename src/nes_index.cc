@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "index/rom_index.h"
+
+namespace {
+
+constexpr char kUsage[] =
+    "Usage:\n"
+    "  nes-index scan rom-dir library.index [--jobs N]\n"
+    "  nes-index list library.index [--mapper N] [--crc XXXXXXXX]\n";
+
+bool IsRomFile(const std::filesystem::path &path) {
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return extension == ".nes";
+}
+
+int Scan(int argc, char *argv[]) {
+  std::string root = argv[2];
+  std::string index_path = argv[3];
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 4; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--jobs" && i + 1 < argc) {
+      jobs = std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::cerr << kUsage;
+      return -1;
+    }
+  }
+
+  // The previous index, if there is one: files whose size and mtime it
+  // already has are not read again.
+  nes::RomIndex previous;
+  bool incremental = std::filesystem::exists(index_path) &&
+                     previous.Open(index_path);
+
+  std::vector<std::string> paths;
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(
+           root, std::filesystem::directory_options::skip_permission_denied,
+           ec);
+       it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+    if (ec) {
+      break;
+    }
+    if (it->is_regular_file(ec) && IsRomFile(it->path())) {
+      paths.push_back(it->path().string());
+    }
+  }
+  if (ec) {
+    std::cerr << std::format("Cannot scan: {}: {}\n", root, ec.message());
+    return -1;
+  }
+
+  // Workers take the next file off a shared counter, so a few huge ROMs
+  // don't hold up a whole slice of the list.
+  std::vector<std::optional<nes::RomIndexEntry>> results(paths.size());
+  std::atomic<std::size_t> next = 0;
+  std::atomic<int> unchanged = 0;
+  auto work = [&]() {
+    for (std::size_t i = next++; i < paths.size(); i = next++) {
+      nes::RomIndexEntry entry;
+      if (!nes::StatRomFile(paths[i], &entry)) {
+        continue;
+      }
+
+      const nes::RomIndexEntry *old =
+          incremental ? previous.Find(paths[i]) : nullptr;
+      if (old != nullptr && old->file_size == entry.file_size &&
+          old->mtime_ns == entry.mtime_ns) {
+        results[i] = *old;
+        unchanged++;
+      } else if (nes::IndexRomFile(paths[i], &entry)) {
+        results[i] = entry;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < jobs; ++i) {
+    workers.emplace_back(work);
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<std::pair<std::string, nes::RomIndexEntry>> entries;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    if (results[i].has_value()) {
+      entries.emplace_back(std::move(paths[i]), *results[i]);
+    }
+  }
+
+  std::size_t indexed = entries.size();
+  if (!nes::RomIndex::Write(index_path, std::move(entries))) {
+    return -1;
+  }
+
+  std::cout << std::format("{}: {} roms, {} unchanged, {} skipped\n",
+                           index_path, indexed, unchanged.load(),
+                           paths.size() - indexed);
+  return 0;
+}
+
+int List(int argc, char *argv[]) {
+  std::optional<int> mapper;
+  std::optional<uint32_t> crc;
+  for (int i = 3; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--mapper" && i + 1 < argc) {
+      mapper = std::atoi(argv[++i]);
+    } else if (arg == "--crc" && i + 1 < argc) {
+      crc = std::strtoul(argv[++i], nullptr, 16);
+    } else {
+      std::cerr << kUsage;
+      return -1;
+    }
+  }
+
+  nes::RomIndex index;
+  if (!index.Open(argv[2])) {
+    return -1;
+  }
+
+  for (const nes::RomIndexEntry &entry : index.entries()) {
+    if ((mapper && entry.mapper != *mapper) || (crc && entry.crc32 != *crc)) {
+      continue;
+    }
+
+    std::string flags;
+    flags += (entry.flags & nes::RomIndexEntry::kVerticalMirroring) ? 'V' : 'H';
+    flags += (entry.flags & nes::RomIndexEntry::kBattery) ? 'B' : '-';
+    flags += (entry.flags & nes::RomIndexEntry::kTrainer) ? 'T' : '-';
+    flags += (entry.flags & nes::RomIndexEntry::kFourScreen) ? '4' : '-';
+    flags += (entry.flags & nes::RomIndexEntry::kNes2) ? '2' : '-';
+    std::cout << std::format("{:08X} {:016x} mapper {:3}.{} PRG {:4}K CHR {:4}K "
+                             "{} {}\n",
+                             entry.crc32, entry.content_hash, entry.mapper,
+                             entry.submapper, entry.prg_rom_size / 1024,
+                             entry.chr_rom_size / 1024, flags,
+                             index.path(entry));
+  }
+  return 0;
+}
+
+}  // namespace
+
+// Indexes a ROM library: headers and hashes of every .nes file under a
+// directory, in a file other tools can map and query without opening
+// the ROMs.
+int main(int argc, char *argv[]) {
+  std::string_view command = argc > 1 ? argv[1] : "";
+
+  if (command == "scan" && argc >= 4) {
+    return Scan(argc, argv);
+  } else if (command == "list" && argc >= 3) {
+    return List(argc, argv);
+  }
+
+  std::cerr << kUsage;
+  return -1;
+}
@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "trace/trace.h"
+
+namespace {
+
+constexpr char kUsage[] =
+    "Usage:\n"
+    "  nes-trace convert nestest.log out.trace\n"
+    "  nes-trace diff expected.trace actual.trace "
+    "[--context N] [--max N] [--no-ppu] [--no-cycles]\n"
+    "  nes-trace print xxx.trace [first] [count]\n";
+
+int Convert(const std::string &log_path, const std::string &out_path) {
+  std::ifstream ifs(log_path);
+  if (!ifs.is_open()) {
+    std::cerr << std::format("Cannot open: {}\n", log_path);
+    return -1;
+  }
+
+  nes::TraceWriter writer;
+  if (!writer.Open(out_path)) {
+    return -1;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(ifs, line)) {
+    line_number++;
+    if (line.empty()) {
+      continue;
+    }
+
+    nes::TraceRecord record;
+    if (!nes::TraceRecord::ParseNestestLine(line, &record)) {
+      std::cerr << std::format("{}:{}: cannot parse: {}\n",
+                               log_path, line_number, line);
+      return -1;
+    }
+    writer.Write(record);
+  }
+
+  if (!writer.Close()) {
+    std::cerr << std::format("Cannot write: {}\n", out_path);
+    return -1;
+  }
+  std::cout << std::format("{}: {} records\n", out_path, writer.count());
+  return 0;
+}
+
+int Diff(int argc, char *argv[]) {
+  nes::TraceDiffOptions options;
+  for (int i = 4; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--context" && i + 1 < argc) {
+      options.context = std::atoi(argv[++i]);
+    } else if (arg == "--max" && i + 1 < argc) {
+      options.max_divergences = std::atoi(argv[++i]);
+    } else if (arg == "--no-ppu") {
+      options.compare_ppu = false;
+    } else if (arg == "--no-cycles") {
+      options.compare_cycles = false;
+    } else {
+      std::cerr << kUsage;
+      return -1;
+    }
+  }
+
+  nes::TraceReader expected;
+  nes::TraceReader actual;
+  if (!expected.Open(argv[2]) || !actual.Open(argv[3])) {
+    return -1;
+  }
+
+  int divergences = nes::DiffTraces(
+      [&expected](nes::TraceRecord *record) { return expected.Next(record); },
+      [&actual](nes::TraceRecord *record) { return actual.Next(record); },
+      options, std::cout);
+  return divergences == 0 ? 0 : 1;
+}
+
+int Print(int argc, char *argv[]) {
+  nes::TraceReader reader;
+  if (!reader.Open(argv[2])) {
+    return -1;
+  }
+
+  uint64_t first = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0;
+  uint64_t count = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : UINT64_MAX;
+
+  nes::TraceRecord record;
+  for (uint64_t i = 0; i < first + count && reader.Next(&record); ++i) {
+    if (i >= first) {
+      std::cout << std::format("{:>10} {}\n", i, record.ToString());
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+// Binary CPU traces: nes-emulator --trace and nestest write them, this
+// converts reference logs and compares runs.
+int main(int argc, char *argv[]) {
+  std::string_view command = argc > 1 ? argv[1] : "";
+
+  if (command == "convert" && argc == 4) {
+    return Convert(argv[2], argv[3]);
+  } else if (command == "diff" && argc >= 4) {
+    return Diff(argc, argv);
+  } else if (command == "print" && argc >= 3) {
+    return Print(argc, argv);
+  }
+
+  std::cerr << kUsage;
+  return -1;
+}
@@ -0,0 +1,121 @@
+#include "frame_buffer.h"
+
+#include <cstring>
+
+#include "video/pixels.h"
+
+namespace nes {
+
+namespace {
+
+// Emphasis darkens the two components it doesn't name. See
+// https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits
+constexpr int kAttenuation = 191;  // Out of 256, about 0.746.
+
+// kColors under each of the 8 emphasis settings.
+const std::array<std::array<Color, 0x40>, 8> &EmphasizedColors() {
+  static const std::array<std::array<Color, 0x40>, 8> colors = []() {
+    std::array<std::array<Color, 0x40>, 8> colors;
+    for (int emphasis = 0; emphasis < 8; ++emphasis) {
+      auto scale = [&](uint8_t component, int bit) {
+        bool dimmed = emphasis & ~(1 << bit);
+        return static_cast<uint8_t>(dimmed ? component * kAttenuation / 256
+                                           : component);
+      };
+      for (int i = 0; i < 0x40; ++i) {
+        const Color &color = FrameBuffer::kColors[i];
+        colors[emphasis][i] = { scale(color.r, 0), scale(color.g, 1),
+                                scale(color.b, 2), color.a };
+      }
+    }
+    return colors;
+  }();
+  return colors;
+}
+
+// The same as RGBA words.
+const std::array<std::array<uint32_t, 0x40>, 8> &EmphasizedWords() {
+  static const std::array<std::array<uint32_t, 0x40>, 8> words = []() {
+    std::array<std::array<uint32_t, 0x40>, 8> words;
+    static_assert(sizeof(Color) == sizeof(uint32_t));
+    std::memcpy(words.data(), EmphasizedColors().data(), sizeof(words));
+    return words;
+  }();
+  return words;
+}
+
+}  // namespace
+
+const std::array<Color, 0x40> FrameBuffer::kColors = {
+  Color {0x62, 0x62, 0x62, 0xFF}, Color {0x0, 0x1f, 0xb2, 0xFF}, Color {0x24, 0x4, 0xc8, 0xFF}, Color {0x52, 0x0, 0xb2, 0xFF},
+  Color {0x73, 0x0, 0x76, 0xFF}, Color {0x80, 0x0, 0x24, 0xFF}, Color {0x73, 0xb, 0x0, 0xFF}, Color {0x52, 0x28, 0x0, 0xFF},
+  Color {0x24, 0x44, 0x0, 0xFF}, Color {0x0, 0x57, 0x0, 0xFF}, Color {0x0, 0x5c, 0x0, 0xFF}, Color {0x0, 0x53, 0x24, 0xFF},
+  Color {0x0, 0x3c, 0x76, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
+  Color {0xab, 0xab, 0xab, 0xFF}, Color {0xd, 0x57, 0xff, 0xFF}, Color {0x4b, 0x30, 0xff, 0xFF}, Color {0x8a, 0x13, 0xff, 0xFF},
+  Color {0xbc, 0x8, 0xd6, 0xFF}, Color {0xd2, 0x12, 0x69, 0xFF}, Color {0xc7, 0x2e, 0x0, 0xFF}, Color {0x9d, 0x54, 0x0, 0xFF},
+  Color {0x60, 0x7b, 0x0, 0xFF}, Color {0x20, 0x98, 0x0, 0xFF}, Color {0x0, 0xa3, 0x0, 0xFF}, Color {0x0, 0x99, 0x42, 0xFF},
+  Color {0x0, 0x7d, 0xb4, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
+  Color {0xff, 0xff, 0xff, 0xFF}, Color {0x53, 0xae, 0xff, 0xFF}, Color {0x90, 0x85, 0xff, 0xFF}, Color {0xd3, 0x65, 0xff, 0xFF},
+  Color {0xff, 0x57, 0xff, 0xFF}, Color {0xff, 0x5d, 0xcf, 0xFF}, Color {0xff, 0x77, 0x57, 0xFF}, Color {0xfa, 0x9e, 0x0, 0xFF},
+  Color {0xbd, 0xc7, 0x0, 0xFF}, Color {0x7a, 0xe7, 0x0, 0xFF}, Color {0x43, 0xf6, 0x11, 0xFF}, Color {0x26, 0xef, 0x7e, 0xFF},
+  Color {0x2c, 0xd5, 0xf6, 0xFF}, Color {0x4e, 0x4e, 0x4e, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
+  Color {0xff, 0xff, 0xff, 0xFF}, Color {0xb6, 0xe1, 0xff, 0xFF}, Color {0xce, 0xd1, 0xff, 0xFF}, Color {0xe9, 0xc3, 0xff, 0xFF},
+  Color {0xff, 0xbc, 0xff, 0xFF}, Color {0xff, 0xbd, 0xf4, 0xFF}, Color {0xff, 0xc6, 0xc3, 0xFF}, Color {0xff, 0xd5, 0x9a, 0xFF},
+  Color {0xe9, 0xe6, 0x81, 0xFF}, Color {0xce, 0xf4, 0x81, 0xFF}, Color {0xb6, 0xfb, 0x9a, 0xFF}, Color {0xa9, 0xfa, 0xc3, 0xFF},
+  Color {0xa9, 0xf0, 0xf4, 0xFF}, Color {0xb8, 0xb8, 0xb8, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}
+};
+
+void FrameBuffer::ToRgba(uint32_t *out) const {
+  const auto &emphasized = EmphasizedWords();
+  for (int y = 0; y < kHeight; ++y) {
+    LookupPixels(&pixels[y * kWidth], kWidth,
+                 emphasized[emphasis[y] & 0x07].data(), out + y * kWidth);
+  }
+}
+
+void FrameBuffer::ToRgbaScaled(uint32_t *out, int scale_x,
+                               int scale_y) const {
+  const auto &emphasized = EmphasizedWords();
+  int stride = kWidth * scale_x;
+  std::array<uint32_t, kWidth> line;
+  for (int y = 0; y < kHeight; ++y) {
+    uint32_t *row = out + y * scale_y * stride;
+    LookupPixels(&pixels[y * kWidth], kWidth,
+                 emphasized[emphasis[y] & 0x07].data(), line.data());
+    ScaleRow(line.data(), kWidth, scale_x, row);
+    DuplicateRow(row, stride, stride, scale_y - 1);
+  }
+}
+
+void FrameBuffer::ToRgb565(uint16_t *out) const {
+  const auto &emphasized = EmphasizedColors();
+  for (int y = 0; y < kHeight; ++y) {
+    std::array<uint16_t, 0x40> colors;
+    for (int i = 0; i < 0x40; ++i) {
+      const Color &color = emphasized[emphasis[y] & 0x07][i];
+      colors[i] = (color.r >> 3) << 11 | (color.g >> 2) << 5 | color.b >> 3;
+    }
+    const uint8_t *row = &pixels[y * kWidth];
+    for (int x = 0; x < kWidth; ++x) {
+      *out++ = colors[row[x] & 0x3F];
+    }
+  }
+}
+
+void FrameBuffer::ToGrey(uint8_t *out) const {
+  const auto &emphasized = EmphasizedColors();
+  for (int y = 0; y < kHeight; ++y) {
+    // BT.601 weights.
+    std::array<uint8_t, 0x40> lumas;
+    for (int i = 0; i < 0x40; ++i) {
+      const Color &color = emphasized[emphasis[y] & 0x07][i];
+      lumas[i] = (color.r * 77 + color.g * 150 + color.b * 29) >> 8;
+    }
+    const uint8_t *row = &pixels[y * kWidth];
+    for (int x = 0; x < kWidth; ++x) {
+      *out++ = lumas[row[x] & 0x3F];
+    }
+  }
+}
+
+}  // namespace nes
@@ -0,0 +1,40 @@
+#ifndef NES_EMULATOR_PPU_FRAME_BUFFER_H_
+#define NES_EMULATOR_PPU_FRAME_BUFFER_H_
+
+#include <array>
+#include <cstdint>
+
+#include "raylib.h"
+
+namespace nes {
+
+// What the PPU draws: for every pixel the master palette index it picked,
+// greyscale already applied, and for every line the color emphasis bits
+// of PPUMASK. Colors are only worked out when a consumer asks for them,
+// in the format it wants; headless runs often never do.
+// See https://www.nesdev.org/wiki/PPU_palettes
+struct FrameBuffer {
+  static constexpr int kWidth = 256;
+  static constexpr int kHeight = 240;
+
+  // The 2C02 master palette. I copied from
+  // https://bugzmanov.github.io/nes_ebook/chapter_6_3.html
+  static const std::array<Color, 0x40> kColors;
+
+  // Writes kWidth * kHeight pixels to out, a row at a time. RGBA pixels
+  // are Colors as 32-bit words, see video/pixels.h.
+  void ToRgba(uint32_t *out) const;
+  // Each pixel scale_x by scale_y times, kWidth * scale_x per row.
+  void ToRgbaScaled(uint32_t *out, int scale_x, int scale_y) const;
+  void ToRgb565(uint16_t *out) const;
+  void ToGrey(uint8_t *out) const;  // Luma, 0-255.
+
+  std::array<uint8_t, kWidth * kHeight> pixels = {};
+  // PPUMASK bits 5-7: bit 0 emphasizes red, bit 1 green, bit 2 blue. The
+  // PPU takes them once per line; mid-line changes are rare.
+  std::array<uint8_t, kHeight> emphasis = {};
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_PPU_FRAME_BUFFER_H_
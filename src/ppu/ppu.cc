@@ -1,5 +1,7 @@
 #include "ppu.h"
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
 
 #include "raylib.h"
@@ -9,15 +11,23 @@
 namespace nes {
 
 void PPU::Write(uint16_t addr, uint8_t value) {
+  Sync();
+
   switch (addr) {
     case 0x2000: {
       // See https://www.nesdev.org/wiki/PPU_scrolling#PPU_internal_registers
       PPUCTRL.raw = value;
       t.NAMETABLE = PPUCTRL.NAMETABLE_ADDR;
+      ScheduleA12();
       break;
     }
     case 0x2001: {
+      bool greyscale = PPUMASK.GREYSCALE;
       PPUMASK.raw = value;
+      if (PPUMASK.GREYSCALE != greyscale) {
+        UpdatePaletteColors();
+      }
+      ScheduleA12();
       break;
     }
     case 0x2003: {
@@ -70,10 +80,15 @@ void PPU::Write(uint16_t addr, uint8_t value) {
 }
 
 uint8_t PPU::Read(uint16_t addr) {
+  Sync();
+
   switch (addr) {
     case 0x2002: {
       uint8_t ret = PPUSTATUS.raw;
-      PPUSTATUS.VBLANK = 0;
+      if (PPUSTATUS.VBLANK) {
+        PPUSTATUS.VBLANK = 0;
+        cpu_.Wake();
+      }
       w = 0;
       return ret;
     }
@@ -103,6 +118,7 @@ void PPU::Tick() {
     The line numbers given here correspond to how the internal PPU frame counters count lines.
    */
   one_frame_finished_ = false;
+  dots_++;
 
   // Background tile loaded
   if (PPUMASK.BACKGROUND_RENDERING &&
@@ -192,155 +208,9 @@ void PPU::Tick() {
           oam_[cycles_ / 2 - 1] = 0xFF;
         }
       } else if (cycles_ >= 65 && cycles_ <= 256) {
-        if (cycles_ % 2 != 0) { // odd cycles
-          // On odd cycles, data is read from (primary) OAM
-          oam_data_latch_ = OAM[n * 4 + m];
-        } else { // even cycles
-          // On even cycles, data is written to secondary OAM
-          // (unless secondary OAM is full, in which case it will read the value in secondary OAM instead)
-          switch (sprite_evaluation_state_) {
-            case kLessEight: {
-              if (m == 0) {
-                // Check y-coord whether in range.
-                if (scanline_ >= oam_data_latch_ &&
-                    scanline_ <= oam_data_latch_ + 7) {
-                  oam_size_++;
-                  if (oam_size_ > 8) {
-                    oam_size_ = 8;
-                    sprite_evaluation_state_ = kGreaterEight;
-                  } else {
-                    oam_[(oam_size_ - 1) * 4 + m] = oam_data_latch_;
-                    m++;
-                  }
-                } else {
-                  m = 0;
-                  n++;
-
-                  if (n >= 64) {
-                    sprite_evaluation_state_ = kFail;
-                  }
-                }
-              } else {
-                nes_assert(oam_size_ != 0, "Invalid oam_size_!!!");
-
-                oam_[(oam_size_ - 1) * 4 + m] = oam_data_latch_;
-                m++;
-                if (m >= 4) {
-                  m = 0;
-                  n++;
-                  if (n >= 64) {
-                    sprite_evaluation_state_ = kFail;
-                  }
-                }
-              }
-              break;
-            }
-            case kGreaterEight: {
-              // We don't read oam.
-              if (m == 0) {
-                // Check y-coord whether in range.
-                if (scanline_ >= oam_data_latch_ &&
-                    scanline_ <= oam_data_latch_ + 7) {
-                  PPUSTATUS.SPRITE_OVERFLOW = 1;
-                  m++;
-                } else {
-                  n++;
-                  m++;
-
-                  // Make sure the m not leaked
-                  if (m >= 4) {
-                    m = 0;
-                  }
-
-                  if (n >= 64) {
-                    sprite_evaluation_state_ = kFail;
-                    n = 0;
-                    m = 0;
-                  }
-                }
-              } else {
-                m++;
-                if (m >= 4) {
-                  m = 0;
-                  n++;
-                }
-              }
-              break;
-            }
-            case kFail: {
-              // We just do nothing here.
-              break;
-            }
-          }
-        }
+        EvaluateSprites(cycles_);
       } else if (cycles_ >= 257 && cycles_ <= 320) {
-        if (cycles_ == 257) {
-          sprites_idx_ = 0;
-          sprites_count_ = oam_size_;
-        }
-
-        if (sprites_idx_ < sprites_count_) {
-          int tmp = cycles_ % 8;
-
-          switch (cycles_ % 8) {
-            case 0: {
-              sprites_idx_++;
-              break;
-            }
-            case 1: {
-              sprites_[sprites_idx_].y = oam_[sprites_idx_ * 4 + (tmp - 1)];
-              break;
-            }
-            case 2: {
-              // Tile number
-              sprites_[sprites_idx_].tile_number = oam_[sprites_idx_ * 4 + (tmp - 1)];
-              break;
-            }
-            case 3: {
-              // Attributes
-              uint8_t attr = oam_[sprites_idx_ * 4 + (tmp - 1)];
-              sprites_[sprites_idx_].palette = (attr & 0x3);
-              sprites_[sprites_idx_].flip_h = (attr & 0x40) > 0;
-              sprites_[sprites_idx_].flip_v = (attr & 0x80) > 0;
-              sprites_[sprites_idx_].priority = (attr & 0x20) > 0;
-
-              if (PPUCTRL.SPRITE_SIZE == 0) {
-                // 8 x 8
-                uint8_t tile_number = sprites_[sprites_idx_].tile_number;
-                uint16_t base =
-                    PPUCTRL.SPRITE_PATTERN_ADDR * 0x1000 + tile_number * 16;
-                uint16_t pattern_addr = 0;
-
-                if (sprites_[sprites_idx_].flip_v) {
-                  pattern_addr =
-                      base + 7 - (scanline_ - sprites_[sprites_idx_].y);
-                } else {
-                  pattern_addr =
-                      base + (scanline_ - sprites_[sprites_idx_].y);
-                }
-                sprites_[sprites_idx_].pattern_ls_shift =
-                    ReadVRAM(pattern_addr);
-                sprites_[sprites_idx_].pattern_ms_shift =
-                    ReadVRAM(pattern_addr + 8);
-              } else {
-                // 8 x 16
-              }
-
-              if (sprites_[sprites_idx_].flip_h) {
-                sprites_[sprites_idx_].pattern_ls_shift =
-                    flip_h(sprites_[sprites_idx_].pattern_ls_shift);
-                sprites_[sprites_idx_].pattern_ms_shift =
-                    flip_h(sprites_[sprites_idx_].pattern_ms_shift);
-              }
-              break;
-            }
-            case 4: {
-              // X coord
-              sprites_[sprites_idx_].x = oam_[sprites_idx_ * 4 + (tmp - 1)];
-              break;
-            }
-          }
-        }
+        FetchSprites(cycles_);
       }
     }
   }
@@ -349,7 +219,8 @@ void PPU::Tick() {
   if (scanline_ >= 0 && scanline_ <= 239 && cycles_ >= 1 && cycles_ <= 256) {
     uint8_t bg_palette_idx = 0;
     uint8_t sp_palette_idx = 0;
-    Color final_color;
+    // Backdrop, unless the background or a sprite covers it.
+    uint8_t final_color = palette_colors_[0];
 
     // Background
     if (PPUMASK.BACKGROUND_RENDERING) {
@@ -370,14 +241,11 @@ void PPU::Tick() {
         }
       }
 
-      uint8_t coloridx;
       if (bg_palette_idx == 0) {
-        coloridx = ReadVRAM(0x3F00);
+        final_color = palette_colors_[0];
       } else {
-        coloridx = ReadVRAM(0x3F00 + (ams * 2 + als) * 4 + bg_palette_idx);
+        final_color = palette_colors_[(ams * 2 + als) * 4 + bg_palette_idx];
       }
-
-      final_color = kColors[coloridx];
     }
 
     // Sprite
@@ -385,10 +253,7 @@ void PPU::Tick() {
       for (int i = 0; i < sprites_count_; ++i) {
         sprites_[i].x--;
         if (sprites_[i].x <= 0 && sprites_[i].x >= -7) {
-          uint8_t plane0 = (sprites_[i].pattern_ls_shift & 0x80) > 0;
-          uint8_t plane1 = (sprites_[i].pattern_ms_shift & 0x80) > 0;
-
-          sp_palette_idx = plane0 + plane1 * 2;
+          sp_palette_idx = sprites_[i].pattern & 0x3;
 
           if (cycles_ >= 1 && cycles_ <= 8) {
             if (PPUMASK.SPRITES == 0) {
@@ -398,36 +263,37 @@ void PPU::Tick() {
           }
 
           uint8_t palette = sprites_[i].palette;
-          uint8_t coloridx = ReadVRAM(0x3F00 + (4 + palette) * 4 + sp_palette_idx);
+          uint8_t color = palette_colors_[(4 + palette) * 4 + sp_palette_idx];
 
           // Sprite 0 hit detect
           if (i == 0) {
-            if (bg_palette_idx != 0 && sp_palette_idx != 0) {
+            if (bg_palette_idx != 0 && sp_palette_idx != 0 &&
+                !PPUSTATUS.SPRITE_HIT) {
               PPUSTATUS.SPRITE_HIT = 1;
+              cpu_.Wake();
             }
           }
 
           if (bg_palette_idx == 0) {
             if (sp_palette_idx != 0) {
-              final_color = kColors[coloridx];
+              final_color = color;
             } else {
               // Backdrop color
-              final_color = kColors[ReadVRAM(0x3F00)];
+              final_color = palette_colors_[0];
             }
           } else {
             if (sp_palette_idx != 0 && !sprites_[i].priority) {
-              final_color = kColors[coloridx];
+              final_color = color;
             }
           }
 
-          sprites_[i].pattern_ls_shift <<= 1;
-          sprites_[i].pattern_ms_shift <<= 1;
+          sprites_[i].pattern >>= 8;
         }
       }
     }
-    if (PPUMASK.SPRITE_RENDERING || PPUMASK.BACKGROUND_RENDERING) {
-      pixels_[scanline_ * 256 + (cycles_ - 1)] = final_color;
-    }
+    // With rendering off (forced blank) the backdrop color goes out.
+    frame_buffer_.pixels[scanline_ * 256 + (cycles_ - 1)] = final_color;
+    frame_buffer_.emphasis[scanline_] = PPUMASK.EMPHASIS;
   }
 
   // Pre scanline
@@ -438,12 +304,14 @@ void PPU::Tick() {
       if (PPUSTATUS.SPRITE_HIT) {
         PPUSTATUS.SPRITE_HIT = 0;
       }
+      cpu_.Wake();
     }
   }
 
   // VBLANK
   if (scanline_ == 241 && cycles_ == 1) {
     PPUSTATUS.VBLANK = 1;
+    cpu_.Wake();
     if (PPUCTRL.VBLANK_NMI) {
       cpu_.nmi_flipflop = true;
     }
@@ -451,22 +319,549 @@ void PPU::Tick() {
 
   cycles_++;
   if (cycles_ > kCycles) {
-    scanline_++;
-
-    // New scanline
-    sprite_evaluation_state_ = kLessEight;
-    oam_size_ = 0;
-    n_overflow_ = false;
-    n = 0;
-    m = 0;
+    EndScanline();
+  }
+}
+
+void PPU::EndScanline() {
+  scanline_++;
+
+  // New scanline
+  sprite_evaluation_state_ = kLessEight;
+  oam_size_ = 0;
+  n_overflow_ = false;
+  n = 0;
+  m = 0;
+  sprites_idx_ = 0;
+
+  if (scanline_ > kScanLine) {
+    scanline_ = 0;
+    one_frame_finished_ = true;
+    frame_++;
+  }
+  cycles_ = 0;
+}
+
+bool PPU::RunScanline(uint64_t end) {
+  if (!scanline_renderer_enabled_ || cycles_ != 0 || end - dots_ <= kCycles) {
+    return false;
+  }
+  // CatchUp() reports an A12 rise at the end of the line. The one that
+  // raises the IRQ has to come on time for an idle CPU waiting on it.
+  if (a12_rise_dot_ <= dots_ + kCycles + 1 &&
+      cartridge_.mapper->A12RisesUntilIrq() == 1) {
+    return false;
+  }
+
+  bool rendering = PPUMASK.BACKGROUND_RENDERING || PPUMASK.SPRITE_RENDERING;
+  if (scanline_ <= 239 && rendering) {
+    // A CPU polling PPUSTATUS has to be woken on the very dot a sprite
+    // flag changes, see CatchUp().
+    if (!PPUMASK.BACKGROUND_RENDERING ||
+        (cpu_.waiting_on_status() && SpriteFlagsMayChange())) {
+      return false;
+    }
+    RenderScanline();
+  } else if (scanline_ <= 239) {
+    // Forced blank, the whole line is the backdrop as in Tick().
+    std::fill_n(&frame_buffer_.pixels[scanline_ * 256], 256,
+                palette_colors_[0]);
+    frame_buffer_.emphasis[scanline_] = PPUMASK.EMPHASIS;
+  } else if (scanline_ == 241 || scanline_ == kScanLine) {
+    // VBLANK starts and ends on these, let Tick() handle them.
+    return false;
+  }
+  // Otherwise there is nothing to do but count the dots.
+
+  one_frame_finished_ = false;
+  dots_ += kCycles + 1;
+  EndScanline();
+  return true;
+}
+
+bool PPU::SpriteFlagsMayChange() const {
+  if (!PPUMASK.SPRITE_RENDERING) {
+    return false;
+  }
+  if (!PPUSTATUS.SPRITE_HIT && sprites_count_ > 0) {
+    return true;
+  }
+
+  // Evaluation only gets to overflow once it has found 8 sprites.
+  int in_range = 0;
+  for (int i = 0; i < 64; ++i) {
+    if (SpriteInRange(i)) {
+      in_range++;
+    }
+  }
+  return in_range > 8;
+}
+
+void PPU::RenderScanline() {
+  // Tick() shifts the background shift registers before drawing each
+  // pixel and reloads them every 8 dots, so with fine X scroll x the
+  // pixel at dot c is pixel c + x of the line's tiles laid end to end:
+  // the two prefetched on the previous line, then the 32 fetched on this
+  // one. Tiles are TileCache rows with the palette in bits 2-3 of each
+  // pixel, so a pixel with a color indexes palette_colors_ directly. Only the
+  // first tile's palette may differ from pixel to pixel, if rendering was
+  // just turned on.
+  constexpr uint64_t kEveryPixel = 0x0101010101010101;
+  auto palette = [this]() -> uint64_t {
+    return (attr_ms_latch * 2 + attr_ls_latch) * kEveryPixel << 2;
+  };
+  std::array<uint64_t, 34> tiles;
+  tiles[0] = TileCache::DecodeRow(bg_ls_shift >> 8, bg_ms_shift >> 8) |
+             TileCache::DecodeRow(attr_ls_shift, attr_ms_shift) << 2;
+  tiles[1] = TileCache::DecodeRow(bg_ls_shift, bg_ms_shift) | palette();
+
+  // The nametable and attribute fetches of one tile and the attribute
+  // reload 8 dots later. Returns the address of the pattern row.
+  auto fetch_tile = [this]() {
+    tile_id = ReadVRAM(0x2000 | (v.raw & 0x0FFF));
+    attr = ReadVRAM(0x23C0 | (v.raw & 0x0C00) | ((v.raw >> 4) & 0x38) |
+                    ((v.raw >> 2) & 0x07));
+    uint16_t pattern_addr =
+        PPUCTRL.BACKGROUND_PATTERN_ADDR * 0x1000 + tile_id * 16 + v.FINE_Y;
+
+    int coarse_x = (v.COARSE_X >> 1) & 0x1;
+    int coarse_y = (v.COARSE_Y >> 1) & 0x1;
+    int offset = coarse_y * 4 + coarse_x * 2;
+    attr_ls_latch = (attr >> offset) & 0x1;
+    attr_ms_latch = (attr >> (offset + 1)) & 0x1;
+
+    IncrementHorizontalV();
+    return pattern_addr;
+  };
+
+  for (std::size_t i = 2; i < tiles.size(); ++i) {
+    tiles[i] = tile_cache_.Row(fetch_tile(), false) | palette();
+  }
+  IncrementVerticalV();
+
+  uint8_t backdrop = palette_colors_[0];
+  std::array<uint8_t, 256> bg_palette_idx;
+  uint8_t *line = &frame_buffer_.pixels[scanline_ * 256];
+  frame_buffer_.emphasis[scanline_] = PPUMASK.EMPHASIS;
+  for (int column = 0; column < 256; ++column) {
+    int pixel = column + 1 + x;
+    uint8_t entry = tiles[pixel / 8] >> (pixel % 8 * 8);
+
+    uint8_t palette_idx = entry & 0x3;
+    if (column < 8 && PPUMASK.BACKGROUND == 0) {
+      // Hide left 8 pixels of background
+      palette_idx = 0;
+    }
+
+    bg_palette_idx[column] = palette_idx;
+    line[column] = palette_idx == 0 ? backdrop : palette_colors_[entry];
+  }
+
+  if (PPUMASK.SPRITE_RENDERING) {
+    // Tick() moves each sprite one dot left per pixel and draws it while
+    // its x is in [-7, 0], a bit of the pattern per pixel. It goes over
+    // the sprites in order for every pixel, so going over the pixels for
+    // every sprite composites the same.
+    for (int i = 0; i < sprites_count_; ++i) {
+      Sprite &sprite = sprites_[i];
+      int first = std::max(sprite.x, 1);
+      int last = std::min(sprite.x + 7, 256);
+      for (int dot = first; dot <= last; ++dot) {
+        int column = dot - 1;
+        uint8_t sp_palette_idx = sprite.pattern & 0x3;
+        if (dot <= 8 && PPUMASK.SPRITES == 0) {
+          // Hide left 8 pixels of sprite
+          sp_palette_idx = 0;
+        }
+        uint8_t color =
+            palette_colors_[(4 + sprite.palette) * 4 + sp_palette_idx];
+
+        // Sprite 0 hit detect
+        if (i == 0 && bg_palette_idx[column] != 0 && sp_palette_idx != 0 &&
+            !PPUSTATUS.SPRITE_HIT) {
+          PPUSTATUS.SPRITE_HIT = 1;
+          cpu_.Wake();
+        }
+
+        if (bg_palette_idx[column] == 0) {
+          line[column] = sp_palette_idx != 0 ? color : backdrop;
+        } else if (sp_palette_idx != 0 && !sprite.priority) {
+          line[column] = color;
+        }
+
+        sprite.pattern >>= 8;
+      }
+      sprite.x -= 256;
+    }
+
+    // Evaluation and fetches for the next line. Up to 8 sprites in range
+    // are just copied in order; overflow takes the dot by dot version.
+    oam_.fill(0xFF);
+    for (int i = 0; i < 64 && oam_size_ <= 8; ++i) {
+      if (SpriteInRange(i)) {
+        oam_size_++;
+        if (oam_size_ <= 8) {
+          std::copy_n(OAM.begin() + i * 4, 4, oam_.begin() + (oam_size_ - 1) * 4);
+        }
+      }
+    }
+    if (oam_size_ > 8) {
+      oam_.fill(0xFF);
+      oam_size_ = 0;
+      for (int cycle = 65; cycle <= 256; ++cycle) {
+        EvaluateSprites(cycle);
+      }
+    }
+    for (int cycle = 257; cycle <= 320; ++cycle) {
+      FetchSprites(cycle);
+    }
+  }
+
+  // Dot 257, then the first two tiles of the next line (dots 321-336).
+  v.COARSE_X = t.COARSE_X;
+  uint8_t mask = 0x01;
+  v.NAMETABLE = (v.NAMETABLE & ~mask) | (t.NAMETABLE & mask);
+
+  // These stay in planes, Tick() takes over from them.
+  uint16_t first = fetch_tile();
+  attr_ls_shift = attr_ls_latch ? 0xFF : 0x00;
+  attr_ms_shift = attr_ms_latch ? 0xFF : 0x00;
+  uint16_t second = fetch_tile();
+  bg_pattern_ls = ReadVRAM(second);
+  bg_pattern_ms = ReadVRAM(second + 8);
+  bg_ls_shift = (ReadVRAM(first) << 8) | bg_pattern_ls;
+  bg_ms_shift = (ReadVRAM(first + 8) << 8) | bg_pattern_ms;
+}
+
+void PPU::EvaluateSprites(int cycle) {
+  if (cycle % 2 != 0) { // odd cycles
+    // On odd cycles, data is read from (primary) OAM
+    oam_data_latch_ = OAM[n * 4 + m];
+  } else { // even cycles
+    // On even cycles, data is written to secondary OAM
+    // (unless secondary OAM is full, in which case it will read the value in secondary OAM instead)
+    switch (sprite_evaluation_state_) {
+      case kLessEight: {
+        if (m == 0) {
+          // Check y-coord whether in range.
+          if (scanline_ >= oam_data_latch_ &&
+              scanline_ < oam_data_latch_ + SpriteHeight()) {
+            oam_size_++;
+            if (oam_size_ > 8) {
+              oam_size_ = 8;
+              sprite_evaluation_state_ = kGreaterEight;
+            } else {
+              oam_[(oam_size_ - 1) * 4 + m] = oam_data_latch_;
+              m++;
+            }
+          } else {
+            m = 0;
+            n++;
+
+            if (n >= 64) {
+              sprite_evaluation_state_ = kFail;
+            }
+          }
+        } else {
+          nes_assert(oam_size_ != 0, "Invalid oam_size_!!!");
+
+          oam_[(oam_size_ - 1) * 4 + m] = oam_data_latch_;
+          m++;
+          if (m >= 4) {
+            m = 0;
+            n++;
+            if (n >= 64) {
+              sprite_evaluation_state_ = kFail;
+            }
+          }
+        }
+        break;
+      }
+      case kGreaterEight: {
+        // We don't read oam.
+        if (m == 0) {
+          // Check y-coord whether in range.
+          if (scanline_ >= oam_data_latch_ &&
+              scanline_ < oam_data_latch_ + SpriteHeight()) {
+            PPUSTATUS.SPRITE_OVERFLOW = 1;
+            cpu_.Wake();
+            m++;
+          } else {
+            n++;
+            m++;
+
+            // Make sure the m not leaked
+            if (m >= 4) {
+              m = 0;
+            }
+
+            if (n >= 64) {
+              sprite_evaluation_state_ = kFail;
+              n = 0;
+              m = 0;
+            }
+          }
+        } else {
+          m++;
+          if (m >= 4) {
+            m = 0;
+            n++;
+          }
+        }
+        break;
+      }
+      case kFail: {
+        // We just do nothing here.
+        break;
+      }
+    }
+  }
+}
+
+void PPU::FetchSprites(int cycle) {
+  if (cycle == 257) {
     sprites_idx_ = 0;
+    sprites_count_ = oam_size_;
+  }
+
+  if (sprites_idx_ < sprites_count_) {
+    int tmp = cycle % 8;
+
+    switch (cycle % 8) {
+      case 0: {
+        sprites_idx_++;
+        break;
+      }
+      case 1: {
+        sprites_[sprites_idx_].y = oam_[sprites_idx_ * 4 + (tmp - 1)];
+        break;
+      }
+      case 2: {
+        // Tile number
+        sprites_[sprites_idx_].tile_number = oam_[sprites_idx_ * 4 + (tmp - 1)];
+        break;
+      }
+      case 3: {
+        // Attributes
+        uint8_t attr = oam_[sprites_idx_ * 4 + (tmp - 1)];
+        sprites_[sprites_idx_].palette = (attr & 0x3);
+        sprites_[sprites_idx_].flip_h = (attr & 0x40) > 0;
+        sprites_[sprites_idx_].flip_v = (attr & 0x80) > 0;
+        sprites_[sprites_idx_].priority = (attr & 0x20) > 0;
+
+        Sprite &sprite = sprites_[sprites_idx_];
+        int height = SpriteHeight();
+        int row = scanline_ - sprite.y;
+        bool on_line = row >= 0 && row < height;
+        if (sprite.flip_v) {
+          row = height - 1 - row;
+        }
+
+        uint16_t pattern_addr = 0;
+        if (PPUCTRL.SPRITE_SIZE == 0) {
+          // 8 x 8
+          pattern_addr = PPUCTRL.SPRITE_PATTERN_ADDR * 0x1000 +
+                         sprite.tile_number * 16 + row;
+        } else {
+          // 8 x 16: bit 0 of the tile number picks the pattern table. The
+          // top half is the even tile of the pair, the bottom half the odd
+          // one after it. See https://www.nesdev.org/wiki/PPU_OAM#Byte_1
+          pattern_addr = (sprite.tile_number & 0x01) * 0x1000 +
+                         (sprite.tile_number & 0xFE) * 16 + row +
+                         (row >= 8 ? 8 : 0);
+        }
+
+        if (on_line) {
+          sprite.pattern = tile_cache_.Row(pattern_addr, sprite.flip_h);
+        } else {
+          // EvaluateSprites() can leave a sprite that isn't on this line
+          // in secondary OAM. Its row is then outside the tile.
+          uint64_t pattern = TileCache::DecodeRow(ReadVRAM(pattern_addr),
+                                                  ReadVRAM(pattern_addr + 8));
+          sprite.pattern =
+              sprite.flip_h ? __builtin_bswap64(pattern) : pattern;
+        }
+        break;
+      }
+      case 4: {
+        // X coord
+        sprites_[sprites_idx_].x = oam_[sprites_idx_ * 4 + (tmp - 1)];
+        break;
+      }
+    }
+  }
+}
+
+void PPU::WriteOamDma(const uint8_t *page) {
+  Sync();
+  // OAMADDR wraps around and ends up where it started.
+  std::copy(page, page + 256 - OAMADDR, OAM.begin() + OAMADDR);
+  std::copy(page + 256 - OAMADDR, page + 256, OAM.begin());
+}
+
+void PPU::CatchUp(uint64_t cpu_cycles) {
+  uint64_t end = cpu_cycles * 3;
+
+  // An idle CPU has skipped ahead to its deadline. Stop on the dot that
+  // would have woken it, an NMI or a mapper IRQ, and send it back there.
+  bool idle = cpu_.idle();
+  bool irq = idle && cartridge_.mapper->irq();
+  auto woken = [&]() {
+    return idle && (!cpu_.idle() || cpu_.nmi_flipflop ||
+                    (!irq && cartridge_.mapper->irq()));
+  };
 
-    if (scanline_ > kScanLine) {
-      scanline_ = 0;
-      one_frame_finished_ = true;
+  if (a12_exact_) {
+    while (dots_ < end && !woken()) {
+      TrackA12();
+      Tick();
+    }
+  } else {
+    while (dots_ < end && !woken()) {
+      uint64_t stop = std::min(end, a12_rise_dot_);
+      while (dots_ < stop && !woken()) {
+        // A whole scanline can go past the rise, which is then reported
+        // at its end. The mapper's counter doesn't affect rendering.
+        if (cycles_ != 0 || !RunScanline(end)) {
+          Tick();
+        }
+      }
+      if (dots_ >= a12_rise_dot_) {
+        cartridge_.mapper->NotifyA12Rise();
+        ScheduleA12();
+      }
     }
-    cycles_ = 0;
   }
+
+  if (idle && dots_ < end) {
+    cpu_.ResumeIdle((dots_ + 2) / 3);
+  }
+  ScheduleEvents();
+}
+
+void PPU::ScheduleEvents() {
+  // dots_ is 3 times the CPU cycle the PPU is at. An event Tick() handles
+  // in n dots is due at the first CPU cycle that covers them.
+  auto cycle_after = [this](uint64_t dots) { return (dots_ + dots + 2) / 3; };
+
+  scheduler_.Schedule(Scheduler::kVblank, cycle_after(DotsTo(241, 1)));
+  scheduler_.Schedule(Scheduler::kFrameEnd,
+                      cycle_after(DotsTo(kScanLine, kCycles)));
+
+  // A scanline IRQ, so the CPU takes it on time.
+  uint64_t irq = Scheduler::kNever;
+  if (a12_rise_dot_ != kNoA12Rise || a12_exact_) {
+    int rises = cartridge_.mapper->A12RisesUntilIrq();
+    if (rises > 0 && a12_exact_) {
+      // Unpredictable, but rises come from the sprite fetches (usually
+      // the first one) or the background prefetch.
+      uint64_t dots = DotsTo(scanline_, kCycles) + 260;
+      for (int cycle : { 260, 324 }) {
+        dots = std::min<uint64_t>(dots, DotsTo(scanline_, cycle));
+      }
+      irq = cycle_after(dots);
+    } else if (rises > 0) {
+      irq = cycle_after(DotsToA12Rise(rises));
+    }
+  }
+  scheduler_.Schedule(Scheduler::kMapperIrq, irq);
+}
+
+int PPU::DotsTo(int scanline, int cycle) const {
+  int frame = (kScanLine + 1) * (kCycles + 1);
+  int now = scanline_ * (kCycles + 1) + cycles_;
+  return (scanline * (kCycles + 1) + cycle - now + frame) % frame + 1;
+}
+
+void PPU::ScheduleA12() {
+  uint64_t old_rise_dot = a12_rise_dot_;
+  bool old_exact = a12_exact_;
+
+  a12_rise_dot_ = kNoA12Rise;
+  a12_exact_ = false;
+  if (cartridge_.mapper != nullptr && cartridge_.mapper->watches_a12() &&
+      (PPUMASK.BACKGROUND_RENDERING || PPUMASK.SPRITE_RENDERING)) {
+    if (PPUCTRL.SPRITE_SIZE ||
+        PPUCTRL.BACKGROUND_PATTERN_ADDR == PPUCTRL.SPRITE_PATTERN_ADDR) {
+      a12_exact_ = true;
+    } else {
+      // Sprites at $1000: the first sprite fetch. Background at $1000: the
+      // first fetch for the next scanline.
+      int cycle = PPUCTRL.BACKGROUND_PATTERN_ADDR ? 324 : 260;
+      int best = INT_MAX;
+      for (int scanline : { scanline_, (scanline_ + 1) % (kScanLine + 1),
+                            kScanLine }) {
+        if ((scanline <= 239 || scanline == kScanLine) &&
+            DotsTo(scanline, cycle) < best) {
+          best = DotsTo(scanline, cycle);
+          a12_rise_scanline_ = scanline;
+        }
+      }
+      a12_rise_dot_ = dots_ + best;
+    }
+  }
+
+  // The CPU may be running ahead to a deadline from the old schedule.
+  if (a12_rise_dot_ != old_rise_dot || a12_exact_ != old_exact) {
+    ScheduleEvents();
+  }
+}
+
+void PPU::TrackA12() {
+  bool rendering = PPUMASK.BACKGROUND_RENDERING || PPUMASK.SPRITE_RENDERING;
+  if (!rendering || (scanline_ >= 240 && scanline_ != kScanLine)) {
+    // The bus carries whatever the CPU points it at, which isn't modeled;
+    // count only the rendering fetches, as the fast path does.
+    a12_ = false;
+    a12_low_dots_ = 0;
+    return;
+  }
+  if (cycles_ == 0) {
+    return;  // Idle dot.
+  }
+
+  // Each 8-dot group fetches from the nametables ($2xxx, A12 low) and then
+  // the pattern tables. The address goes out a dot before the fetch, hence
+  // dots 260 and 324 in ScheduleA12().
+  bool high;
+  int group = (cycles_ - 1) % 8;
+  if (group < 3 || group == 7 || cycles_ >= 337) {
+    high = false;
+  } else if (cycles_ >= 257 && cycles_ <= 320) {
+    int sprite = (cycles_ - 257) / 8;
+    if (PPUCTRL.SPRITE_SIZE == 0) {
+      high = PPUCTRL.SPRITE_PATTERN_ADDR;
+    } else if (scanline_ != kScanLine && PPUMASK.SPRITE_RENDERING &&
+               sprite < sprites_count_) {
+      // 8x16 sprites pick the table with bit 0 of the tile number.
+      high = sprites_[sprite].tile_number & 0x01;
+    } else {
+      high = true;  // Empty slots fetch tile $FF.
+    }
+  } else {
+    high = PPUCTRL.BACKGROUND_PATTERN_ADDR;
+  }
+
+  if (high && !a12_ && a12_low_dots_ >= kA12Filter) {
+    cartridge_.mapper->NotifyA12Rise();
+  }
+  a12_low_dots_ = high ? 0 : a12_low_dots_ + 1;
+  a12_ = high;
+}
+
+uint64_t PPU::DotsToA12Rise(int rises) const {
+  // Rises happen on the 241 rendered scanlines (0-239 and pre-render),
+  // one each, so count whole frames and then the rest.
+  constexpr int kRenderedLines = 241;
+  int lines = kScanLine + 1;
+  int steps = rises - 1;
+  int index = a12_rise_scanline_ == kScanLine ? 240 : a12_rise_scanline_;
+  int target = (index + steps % kRenderedLines) % kRenderedLines;
+  int scanline = target == 240 ? kScanLine : target;
+
+  uint64_t skipped = steps / kRenderedLines * lines +
+                     (scanline - a12_rise_scanline_ + lines) % lines;
+  return a12_rise_dot_ - dots_ + skipped * (kCycles + 1);
 }
 
 void PPU::TestRenderNametable(uint16_t addr) {
@@ -482,8 +877,8 @@ void PPU::TestRenderNametable(uint16_t addr) {
     int x = (i - addr) % 32;
     int y = (i - addr) / 32;
     for (int j = tile_id * 16; j < tile_id * 16 + 8; ++j) {
-      uint8_t plane0 = cartridge_.chr_rom[j];
-      uint8_t plane1 = cartridge_.chr_rom[j + 8];
+      uint8_t plane0 = ReadVRAM(j);
+      uint8_t plane1 = ReadVRAM(j + 8);
 
       for (int k = 7; k >= 0; --k) {
         uint8_t plane0_bit = (plane0 >> k) & 0x1;
@@ -520,8 +915,8 @@ void PPU::TestRenderSprite() {
     if (!flip_v) {
       // Top
       for (int j = tile_id * 16; j < tile_id * 16 + 8; ++j) {
-        uint8_t plane0 = cartridge_.chr_rom[pattern_addr + j];
-        uint8_t plane1 = cartridge_.chr_rom[pattern_addr + j + 8];
+        uint8_t plane0 = ReadVRAM(pattern_addr + j);
+        uint8_t plane1 = ReadVRAM(pattern_addr + j + 8);
 
         if (!flip_h) {
           for (int k = 7; k >= 0; --k) {
@@ -554,7 +949,7 @@ void PPU::TestPalettes() {
   int y = 0;
   int x = 0;
   for (int i = 0; i < palettes_.size(); i++) {
-    DrawRectangle(100 + x, y, kCellSize, kCellSize, kColors[ReadVRAM(0x3F00 + i)]);
+    DrawRectangle(100 + x, y, kCellSize, kCellSize, FrameBuffer::kColors[ReadVRAM(0x3F00 + i) & 0x3F]);
     x += kCellSize;
     if ((i + 1) % 4 == 0) {
       y += kCellSize + 10;
@@ -570,33 +965,11 @@ uint8_t PPU::ReadVRAM(uint16_t addr) {
 
   if (addr <= 0x1FFF) {
     // PATTERN TABLE
-    return cartridge_.chr_rom[addr];
-  } else if (addr >= 0x2000 && addr <= 0x23FF) {
-    return vram_[addr - 0x2000];
-  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
+    return cartridge_.mapper->ReadChr(addr);
+  } else if (addr >= 0x3F00) {
     return palettes_[(addr - 0x3F00) % 0x20];
-  } else if (cartridge_.Flags6.NAMETABLE_ARRANGEMENT == 0) {
-    if (addr >= 0x2400 && addr <= 0x27FF) {
-      return vram_[addr - 0x2400];
-    } else if (addr >= 0x2800 && addr <= 0x2BFF) {
-      return vram_[addr - 0x2400];
-    } else if (addr >= 0x2C00 && addr <= 0x2FFF) {
-      return vram_[addr - 0x2800];
-    } else {
-      nes_assert(false, std::format("Unsupported vram read: {:#x}", addr));
-    }
-  } else if (cartridge_.Flags6.NAMETABLE_ARRANGEMENT == 1) {
-    if (addr >= 0x2400 && addr <= 0x27FF) {
-      return vram_[addr - 0x2000];
-    } else if (addr >= 0x2800 && addr <= 0x2BFF) {
-      return vram_[addr - 0x2800];
-    } else if (addr >= 0x2C00 && addr <= 0x2FFF) {
-      return vram_[addr - 0x2800];
-    } else {
-      nes_assert(false, std::format("Unsupported vram read: {:#x}", addr));
-    }
   } else {
-    nes_assert(false, std::format("Unsupported vram read: {:#x}", addr));
+    return vram_[NametableOffset(addr)];
   }
 }
 
@@ -605,33 +978,43 @@ void PPU::WriteVRAM(uint16_t addr, uint8_t v) {
     nes_assert(false, std::format("Unsupported vram write: {:#x}", addr));
   }
 
-  if (addr >= 0x2000 && addr <= 0x23FF) {
-    vram_[addr - 0x2000] = v;
-  } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
+  if (addr <= 0x1FFF) {
+    cartridge_.mapper->WriteChr(addr, v);
+    tile_cache_.Invalidate(addr);
+  } else if (addr >= 0x3F00) {
     uint16_t tmp_addr = (addr - 0x3F00) % 0x20;
     if (tmp_addr == 0x10) {
       palettes_[0] = v;
+      UpdatePaletteColor(0);
     }
-    palettes_[(addr - 0x3F00) % 0x20] = v;
-  } else if (cartridge_.Flags6.NAMETABLE_ARRANGEMENT == 0) {
-    if (addr >= 0x2400 && addr <= 0x27FF) {
-      vram_[addr - 0x2400] = v;
-    } else if (addr >= 0x2800 && addr <= 0x2BFF) {
-      vram_[addr - 0x2400] = v;
-    } else if (addr >= 0x2C00 && addr <= 0x2FFF) {
-      vram_[addr - 0x2800] = v;
-    }
-  } else if (cartridge_.Flags6.NAMETABLE_ARRANGEMENT == 1) {
-    if (addr >= 0x2400 && addr <= 0x27FF) {
-      vram_[addr - 0x2000] = v;
-    } else if (addr >= 0x2800 && addr <= 0x2BFF) {
-      vram_[addr - 0x2800] = v;
-    } else if (addr >= 0x2C00 && addr <= 0x2FFF) {
-      vram_[addr - 0x2800] = v;
-    }
+    palettes_[tmp_addr] = v;
+    UpdatePaletteColor(tmp_addr);
+  } else {
+    vram_[NametableOffset(addr)] = v;
   }
 }
 
+void PPU::UpdatePaletteColors() {
+  for (std::size_t i = 0; i < palettes_.size(); ++i) {
+    UpdatePaletteColor(i);
+  }
+}
+
+void PPU::UpdatePaletteColor(int index) {
+  // Palette RAM is 6 bits wide. Greyscale keeps only the column of the
+  // grey colors. See https://www.nesdev.org/wiki/PPU_registers#Color_control
+  uint8_t mask = PPUMASK.GREYSCALE ? 0x30 : 0x3F;
+  palette_colors_[index] = palettes_[index] & mask;
+}
+
+uint16_t PPU::NametableOffset(uint16_t addr) const {
+  // $2000-$2FFF, mirrored up to $3EFF. The mapper decides which of the two
+  // physical nametables each quarter uses.
+  // See https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+  return cartridge_.mapper->nametable((addr >> 10) & 0x03) * 0x400 +
+         (addr & 0x3FF);
+}
+
 void PPU::IncrementHorizontalV() {
   if ((v.raw & 0x001F) == 31) {  // if coarse X == 31
     v.raw &= ~0x001F;            // coarse X = 0
@@ -661,14 +1044,4 @@ void PPU::IncrementVerticalV() {
   }
 }
 
-uint8_t PPU::flip_h(uint8_t arg) {
-  uint8_t result = 0;
-  for (int i = 0; i < 8; ++i) {
-    result <<= 1;
-    uint8_t bit = (arg & (0x1 << i)) > 0;
-    result |= bit;
-  }
-  return result;
-}
-
 }  // namespace nes
@@ -8,6 +8,9 @@
 
 #include "cpu/cpu.h"
 #include "cartridge/cartridge.h"
+#include "ppu/frame_buffer.h"
+#include "ppu/tile_cache.h"
+#include "scheduler/scheduler.h"
 
 namespace nes {
 
@@ -15,10 +18,14 @@ namespace nes {
 
 class PPU {
  public:
-  PPU(Cpu &cpu, Cartridge &cartridge)
-      : cpu_(cpu),
-        cartridge_(cartridge) {
+  PPU(Cpu &cpu, Cartridge &cartridge, Scheduler &scheduler)
+      : tile_cache_(cartridge),
+        cpu_(cpu),
+        cartridge_(cartridge),
+        scheduler_(scheduler) {
     w = 0;
+    UpdatePaletteColors();
+    ScheduleEvents();
   }
 
   void Write(uint16_t addr, uint8_t value);
@@ -26,8 +33,29 @@ class PPU {
 
   void Tick();
 
+  // Batched stepping: the CPU runs ahead up to the scheduler's deadline,
+  // then CatchUp() brings the PPU to the same point. Register accesses,
+  // mapper writes and OAM DMA call Sync() first, so the CPU always sees
+  // the PPU as of the instruction doing the access. An idle CPU may be
+  // woken before cpu_cycles and sent back, see Cpu::Wake().
+  void CatchUp(uint64_t cpu_cycles);
+  void Sync() { CatchUp(cpu_.instruction_start()); }
+  // Posts vblank, the frame end and the next mapper IRQ to the scheduler.
+  // CatchUp() calls it; so must anyone changing what they depend on.
+  void ScheduleEvents();
+
+  // OAM DMA: the 256 writes to OAMDATA in one go, starting at OAMADDR.
+  void WriteOamDma(const uint8_t *page);
+
+  // Lets CatchUp() render whole scanlines in one pass instead of dot by
+  // dot, see RunScanline(). The output is the same either way.
+  void set_scanline_renderer_enabled(bool enabled) {
+    scanline_renderer_enabled_ = enabled;
+  }
+
   bool one_frame_finished() const { return one_frame_finished_; }
-  const std::array<Color, 256 * 240> &pixels() const { return pixels_; }
+  uint64_t frame() const { return frame_; }  // Frames finished so far.
+  const FrameBuffer &frame_buffer() const { return frame_buffer_; }
 
   // These functions just for test.
   void TestRenderNametable(uint16_t addr);
@@ -40,11 +68,54 @@ class PPU {
  private:
   uint8_t ReadVRAM(uint16_t addr);
   void WriteVRAM(uint16_t addr, uint8_t v);
+  uint16_t NametableOffset(uint16_t addr) const;
+  // Refresh palette_colors_ after a palette write or a PPUMASK greyscale
+  // change.
+  void UpdatePaletteColors();
+  void UpdatePaletteColor(int index);
 
   void IncrementHorizontalV();
   void IncrementVerticalV();
 
-  uint8_t flip_h(uint8_t arg);
+  // Sprite evaluation (dots 65-256) and sprite fetches (dots 257-320) of
+  // a visible scanline, one dot per call.
+  void EvaluateSprites(int cycle);
+  void FetchSprites(int cycle);
+  // Moves on to the next scanline once Tick() has handled dot 340.
+  void EndScanline();
+
+  // Runs a whole scanline at once if CatchUp() is at its start and has to
+  // go past its end. Nothing can touch the PPU in between: every register
+  // access, mapper write and OAM DMA syncs first, so a write in the middle
+  // of a line stops the catch up there and the rest of the line goes
+  // through Tick(). Returns false if the line needs Tick() anyway.
+  bool RunScanline(uint64_t end);
+  // Whether sprite 0 hit or sprite overflow could be set on this line.
+  bool SpriteFlagsMayChange() const;
+  // 8 or 16 lines, see PPUCTRL.SPRITE_SIZE.
+  int SpriteHeight() const { return PPUCTRL.SPRITE_SIZE ? 16 : 8; }
+  // Whether OAM entry index covers this line, as evaluation checks it.
+  bool SpriteInRange(int index) const {
+    uint8_t y = OAM[index * 4];
+    return scanline_ >= y && scanline_ < y + SpriteHeight();
+  }
+  // A visible scanline with background rendering on: Tick() for dots
+  // 0-340, with the background fetched a tile at a time and the pixels
+  // composited in one pass. Leaves the same state behind.
+  void RenderScanline();
+
+  // Dots until Tick() has handled the given position.
+  int DotsTo(int scanline, int cycle) const;
+
+  // Scanline counters (MMC3) count rises of pattern table address line
+  // A12. With 8x8 sprites and different background and sprite tables it
+  // rises exactly once per rendered scanline, at dot 260 or 324, so
+  // CatchUp() just stops at that dot and Tick() pays nothing. Any other
+  // setup falls back to TrackA12() following the fetch schedule dot by
+  // dot. See https://www.nesdev.org/wiki/MMC3#IRQ_Specifics
+  void ScheduleA12();
+  void TrackA12();
+  uint64_t DotsToA12Rise(int rises) const;
 
  private:
   // See https://www.nesdev.org/wiki/PPU_registers#PPUCTRL
@@ -69,6 +140,7 @@ class PPU {
       uint8_t SPRITES : 1;
       uint8_t BACKGROUND_RENDERING : 1;
       uint8_t SPRITE_RENDERING : 1;
+      uint8_t EMPHASIS : 3;
     };
     uint8_t raw;
   } PPUMASK;
@@ -128,8 +200,7 @@ class PPU {
 
   struct Sprite {
     uint8_t tile_number;
-    uint8_t pattern_ls_shift;
-    uint8_t pattern_ms_shift;
+    uint64_t pattern;  // Pixels left to draw, a TileCache row.
     int x;
     int y;
     uint8_t palette;
@@ -149,39 +220,36 @@ class PPU {
   std::array<uint8_t, 4 * 8> oam_;
   std::array<uint8_t, 0x0800> vram_;
   std::array<uint8_t, 0x20> palettes_;
+  // The master palette indices palettes_ stands for, greyscale applied,
+  // so drawing a pixel is one lookup.
+  std::array<uint8_t, 0x20> palette_colors_;
+  TileCache tile_cache_;
 
-  std::array<Color, 256 * 240> pixels_;
-
-  // I copied from https://bugzmanov.github.io/nes_ebook/chapter_6_3.html
-  const std::array<Color, 0x40> kColors = {
-    Color {0x62, 0x62, 0x62, 0xFF}, Color {0x0, 0x1f, 0xb2, 0xFF}, Color {0x24, 0x4, 0xc8, 0xFF}, Color {0x52, 0x0, 0xb2, 0xFF},
-    Color {0x73, 0x0, 0x76, 0xFF}, Color {0x80, 0x0, 0x24, 0xFF}, Color {0x73, 0xb, 0x0, 0xFF}, Color {0x52, 0x28, 0x0, 0xFF},
-    Color {0x24, 0x44, 0x0, 0xFF}, Color {0x0, 0x57, 0x0, 0xFF}, Color {0x0, 0x5c, 0x0, 0xFF}, Color {0x0, 0x53, 0x24, 0xFF},
-    Color {0x0, 0x3c, 0x76, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
-    Color {0xab, 0xab, 0xab, 0xFF}, Color {0xd, 0x57, 0xff, 0xFF}, Color {0x4b, 0x30, 0xff, 0xFF}, Color {0x8a, 0x13, 0xff, 0xFF},
-    Color {0xbc, 0x8, 0xd6, 0xFF}, Color {0xd2, 0x12, 0x69, 0xFF}, Color {0xc7, 0x2e, 0x0, 0xFF}, Color {0x9d, 0x54, 0x0, 0xFF},
-    Color {0x60, 0x7b, 0x0, 0xFF}, Color {0x20, 0x98, 0x0, 0xFF}, Color {0x0, 0xa3, 0x0, 0xFF}, Color {0x0, 0x99, 0x42, 0xFF},
-    Color {0x0, 0x7d, 0xb4, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
-    Color {0xff, 0xff, 0xff, 0xFF}, Color {0x53, 0xae, 0xff, 0xFF}, Color {0x90, 0x85, 0xff, 0xFF}, Color {0xd3, 0x65, 0xff, 0xFF},
-    Color {0xff, 0x57, 0xff, 0xFF}, Color {0xff, 0x5d, 0xcf, 0xFF}, Color {0xff, 0x77, 0x57, 0xFF}, Color {0xfa, 0x9e, 0x0, 0xFF},
-    Color {0xbd, 0xc7, 0x0, 0xFF}, Color {0x7a, 0xe7, 0x0, 0xFF}, Color {0x43, 0xf6, 0x11, 0xFF}, Color {0x26, 0xef, 0x7e, 0xFF},
-    Color {0x2c, 0xd5, 0xf6, 0xFF}, Color {0x4e, 0x4e, 0x4e, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF},
-    Color {0xff, 0xff, 0xff, 0xFF}, Color {0xb6, 0xe1, 0xff, 0xFF}, Color {0xce, 0xd1, 0xff, 0xFF}, Color {0xe9, 0xc3, 0xff, 0xFF},
-    Color {0xff, 0xbc, 0xff, 0xFF}, Color {0xff, 0xbd, 0xf4, 0xFF}, Color {0xff, 0xc6, 0xc3, 0xFF}, Color {0xff, 0xd5, 0x9a, 0xFF},
-    Color {0xe9, 0xe6, 0x81, 0xFF}, Color {0xce, 0xf4, 0x81, 0xFF}, Color {0xb6, 0xfb, 0x9a, 0xFF}, Color {0xa9, 0xfa, 0xc3, 0xFF},
-    Color {0xa9, 0xf0, 0xf4, 0xFF}, Color {0xb8, 0xb8, 0xb8, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}, Color {0x0, 0x0, 0x0, 0xFF}
-  };
+  FrameBuffer frame_buffer_;
 
-  const int kScanLine = 261;
-  const int kCycles = 340;
+  static constexpr int kScanLine = 261;
+  static constexpr int kCycles = 340;
 
   bool one_frame_finished_;
+  bool scanline_renderer_enabled_ = false;
 
   int scanline_ = 0;
   int cycles_ = 0;
+  uint64_t dots_ = 0;  // Ticks since power on, 3 per CPU cycle.
+  uint64_t frame_ = 0;
+
+  static constexpr uint64_t kNoA12Rise = UINT64_MAX;
+  // The MMC3 ignores rises unless A12 was low for about 3 CPU cycles.
+  static constexpr int kA12Filter = 10;
+  uint64_t a12_rise_dot_ = kNoA12Rise;  // Value of dots_ after the rise.
+  int a12_rise_scanline_ = 0;
+  bool a12_exact_ = false;
+  bool a12_ = false;
+  int a12_low_dots_ = 0;
 
   Cpu &cpu_;
   Cartridge &cartridge_;
+  Scheduler &scheduler_;
 };
 
 }  // namespace nes
@@ -0,0 +1,48 @@
+#include "tile_cache.h"
+
+#include <algorithm>
+
+namespace nes {
+
+void TileCache::Invalidate(uint16_t address) {
+  // Windows are 1KB aligned, so two of them either are the same memory or
+  // don't overlap. Boards with less CHR RAM than the PPU addresses show the
+  // same bank in several windows.
+  const Mapper &mapper = *cartridge_.mapper;
+  const uint8_t *window = mapper.chr_window(address >> 10);
+  for (int slot = 0; slot < 8; ++slot) {
+    if (mapper.chr_window(slot) == window) {
+      decoded_[slot * 64 + ((address & 0x3FF) >> 4)] = false;
+    }
+  }
+}
+
+uint64_t TileCache::DecodeRow(uint8_t plane0, uint8_t plane1) {
+  uint64_t row = 0;
+  for (int i = 0; i < 8; ++i) {
+    uint64_t pixel = ((plane0 >> (7 - i)) & 0x1) |
+                     ((plane1 >> (7 - i)) & 0x1) << 1;
+    row |= pixel << (i * 8);
+  }
+  return row;
+}
+
+void TileCache::Remap(int slot) {
+  windows_[slot] = cartridge_.mapper->chr_window(slot);
+  std::fill_n(decoded_.begin() + slot * 64, 64, false);
+}
+
+void TileCache::Decode(int index) {
+  const Mapper &mapper = *cartridge_.mapper;
+  Tile &tile = tiles_[index];
+  for (int y = 0; y < 8; ++y) {
+    uint16_t address = index * 16 + y;
+    tile.rows[y] =
+        DecodeRow(mapper.ReadChr(address), mapper.ReadChr(address + 8));
+    // Mirroring reverses the order of the pixels, one per byte.
+    tile.flipped[y] = __builtin_bswap64(tile.rows[y]);
+  }
+  decoded_[index] = true;
+}
+
+}  // namespace nes
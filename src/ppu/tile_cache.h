@@ -0,0 +1,66 @@
+#ifndef NES_EMULATOR_PPU_TILE_CACHE_H_
+#define NES_EMULATOR_PPU_TILE_CACHE_H_
+
+#include <array>
+#include <cstdint>
+
+#include "cartridge/cartridge.h"
+
+namespace nes {
+
+// The 512 tiles of the pattern tables ($0000-$1FFF), decoded to one byte
+// per pixel. See https://www.nesdev.org/wiki/PPU_pattern_tables
+//
+// A row is a uint64_t with the 2-bit color index of pixel i, counting
+// from the left, in bits 8i to 8i+7. Drawing a pixel is then a mask and
+// moving to the next one a shift by 8, instead of a bit out of each
+// plane. Tiles are decoded the first time they are used, both as is and
+// mirrored horizontally.
+//
+// The cache follows the mapper's eight 1KB CHR windows: once a window
+// points somewhere else, its 64 tiles are decoded again. CHR RAM is only
+// written through the PPU, which calls Invalidate().
+class TileCache {
+ public:
+  explicit TileCache(Cartridge &cartridge) : cartridge_(cartridge) {}
+
+  // Row of the tile at a pattern table address, that is the address of
+  // its plane 0 byte.
+  uint64_t Row(uint16_t address, bool flip_h) {
+    int slot = address >> 10;
+    if (windows_[slot] != cartridge_.mapper->chr_window(slot)) {
+      Remap(slot);
+    }
+
+    int index = address >> 4;
+    if (!decoded_[index]) {
+      Decode(index);
+    }
+    const Tile &tile = tiles_[index];
+    return flip_h ? tile.flipped[address & 0x07] : tile.rows[address & 0x07];
+  }
+
+  // A write to the pattern tables at address.
+  void Invalidate(uint16_t address);
+
+  // Pixel i is bit 7 - i of each plane.
+  static uint64_t DecodeRow(uint8_t plane0, uint8_t plane1);
+
+ private:
+  struct Tile {
+    std::array<uint64_t, 8> rows;
+    std::array<uint64_t, 8> flipped;
+  };
+
+  void Remap(int slot);
+  void Decode(int index);
+
+  Cartridge &cartridge_;
+  std::array<const uint8_t *, 8> windows_ = {};
+  std::array<bool, 512> decoded_ = {};
+  std::array<Tile, 512> tiles_;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_PPU_TILE_CACHE_H_
@@ -0,0 +1,29 @@
+#include "scheduler.h"
+
+namespace nes {
+
+void Scheduler::Schedule(Event event, uint64_t cycle) {
+  if (when_[event] == cycle) {
+    return;
+  }
+
+  when_[event] = cycle;
+  if (cycle != kNever) {
+    queue_.push({ cycle, event });
+    cpu_.LimitRun(cycle);
+  }
+}
+
+uint64_t Scheduler::deadline() {
+  while (!queue_.empty() && queue_.top().cycle != when_[queue_.top().event]) {
+    queue_.pop();
+  }
+  return queue_.empty() ? kNever : queue_.top().cycle;
+}
+
+uint64_t Scheduler::CyclesToDeadline() {
+  uint64_t end = deadline();
+  return end > cpu_.cycles ? end - cpu_.cycles : 1;
+}
+
+}  // namespace nes
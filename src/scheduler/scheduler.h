@@ -0,0 +1,63 @@
+#ifndef NES_EMULATOR_SCHEDULER_SCHEDULER_H_
+#define NES_EMULATOR_SCHEDULER_SCHEDULER_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "cpu/cpu.h"
+
+namespace nes {
+
+// The machine's master clock. Times are CPU cycles since power on (see
+// Cpu::cycles). Each component posts when its next event that the CPU
+// could observe will happen; the CPU runs up to the earliest of them in
+// one batch, then the component catches up and handles it.
+//
+// Events the CPU only sees by reading a register (sprite 0 hit, sprite
+// overflow) need no entry, since register accesses sync the PPU. OAM DMA
+// is a single jump of the clock, see BasicCpu::Write().
+class Scheduler {
+ public:
+  enum Event : uint8_t {
+    kVblank = 0,  // PPU: VBLANK set and NMI, if enabled.
+    kFrameEnd,    // PPU: last dot of the pre-render scanline.
+    kMapperIrq,   // Cartridge: /IRQ goes low (predicted by the PPU).
+    kEventCount,
+  };
+
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  explicit Scheduler(Cpu &cpu) : cpu_(cpu) { when_.fill(kNever); }
+
+  // Sets when event happens next, replacing the previous time; kNever
+  // cancels it. An earlier deadline cuts short the CPU's current Run().
+  void Schedule(Event event, uint64_t cycle);
+  uint64_t when(Event event) const { return when_[event]; }
+
+  // The earliest pending event, kNever if there is none.
+  uint64_t deadline();
+  // Budget for Cpu::Run(): up to the deadline, but at least one cycle so
+  // the CPU always makes progress.
+  uint64_t CyclesToDeadline();
+
+ private:
+  struct Entry {
+    uint64_t cycle;
+    Event event;
+
+    auto operator<=>(const Entry &other) const = default;
+  };
+
+  Cpu &cpu_;
+  std::array<uint64_t, kEventCount> when_;
+  // Rescheduling leaves the old entry in the heap. It is stale once it no
+  // longer matches when_, and is dropped when it reaches the top.
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue_;
+};
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_SCHEDULER_SCHEDULER_H_
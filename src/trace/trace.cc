@@ -0,0 +1,219 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <format>
+#include <iostream>
+#include <ostream>
+
+namespace nes {
+
+namespace {
+
+constexpr char kMagic[4] = { 'N', 'T', 'R', 'C' };
+constexpr uint32_t kVersion = 1;
+
+// Parses the number following label, skipping the padding nestest.log puts
+// in front of short values.
+template <typename T>
+bool ParseField(std::string_view line, std::string_view label, int base,
+                T *value, std::size_t *end = nullptr) {
+  std::size_t pos = line.find(label);
+  if (pos == std::string_view::npos) {
+    return false;
+  }
+
+  const char *first = line.data() + pos + label.size();
+  const char *last = line.data() + line.size();
+  while (first != last && *first == ' ') {
+    first++;
+  }
+
+  auto [ptr, ec] = std::from_chars(first, last, *value, base);
+  if (end != nullptr) {
+    *end = ptr - line.data();
+  }
+  return ec == std::errc();
+}
+
+}  // namespace
+
+bool TraceRecord::ParseNestestLine(std::string_view line, TraceRecord *record) {
+  TraceRecord result;
+  if (!ParseField(line.substr(0, 4), "", 16, &result.pc) ||
+      !ParseField(line, " A:", 16, &result.a) ||
+      !ParseField(line, " X:", 16, &result.x) ||
+      !ParseField(line, " Y:", 16, &result.y) ||
+      !ParseField(line, " P:", 16, &result.p) ||
+      !ParseField(line, " SP:", 16, &result.sp) ||
+      !ParseField(line, " CYC:", 10, &result.cycles)) {
+    return false;
+  }
+
+  // "PPU:  0, 21" is scanline, dot.
+  std::size_t end = 0;
+  if (ParseField(line, " PPU:", 10, &result.scanline, &end)) {
+    if (!ParseField(line.substr(end), ",", 10, &result.dot)) {
+      return false;
+    }
+  }
+
+  *record = result;
+  return true;
+}
+
+std::string TraceRecord::ToString() const {
+  return std::format("{:04X} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X} "
+                     "PPU:{:3},{:3} CYC:{}",
+                     pc, a, x, y, p, sp, scanline, dot, cycles);
+}
+
+TraceWriter::~TraceWriter() {
+  if (ofs_.is_open()) {
+    Close();
+  }
+}
+
+bool TraceWriter::Open(const std::string &path) {
+  ofs_.open(path, std::ios::binary);
+  if (!ofs_.is_open()) {
+    std::cerr << std::format("Cannot write: {}\n", path);
+    return false;
+  }
+
+  ofs_.write(kMagic, sizeof(kMagic));
+  ofs_.write(reinterpret_cast<const char *>(&kVersion), sizeof(kVersion));
+  buffer_.reserve(kBufferRecords);
+  count_ = 0;
+  return ofs_.good();
+}
+
+void TraceWriter::Flush() {
+  ofs_.write(reinterpret_cast<const char *>(buffer_.data()),
+             buffer_.size() * sizeof(TraceRecord));
+  count_ += buffer_.size();
+  buffer_.clear();
+}
+
+bool TraceWriter::Close() {
+  Flush();
+  ofs_.close();
+  return !ofs_.fail();
+}
+
+bool TraceReader::Open(const std::string &path) {
+  ifs_.open(path, std::ios::binary);
+  if (!ifs_.is_open()) {
+    std::cerr << std::format("Cannot open: {}\n", path);
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version = 0;
+  ifs_.read(magic, sizeof(magic));
+  ifs_.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!ifs_ || !std::equal(magic, magic + 4, kMagic) || version != kVersion) {
+    std::cerr << std::format("Invalid trace: {}\n", path);
+    return false;
+  }
+
+  buffer_.clear();
+  pos_ = 0;
+  return true;
+}
+
+bool TraceReader::Next(TraceRecord *record) {
+  if (pos_ == buffer_.size()) {
+    buffer_.resize(1 << 14);
+    ifs_.read(reinterpret_cast<char *>(buffer_.data()),
+              buffer_.size() * sizeof(TraceRecord));
+    buffer_.resize(ifs_.gcount() / sizeof(TraceRecord));
+    pos_ = 0;
+    if (buffer_.empty()) {
+      return false;
+    }
+  }
+
+  *record = buffer_[pos_++];
+  return true;
+}
+
+int DiffTraces(const TraceSource &expected, const TraceSource &actual,
+               const TraceDiffOptions &options, std::ostream &out) {
+  auto differences = [&options](const TraceRecord &e, const TraceRecord &a) {
+    std::string fields;
+    auto check = [&fields](bool same, const char *name) {
+      if (!same) {
+        fields += fields.empty() ? name : std::format(" {}", name);
+      }
+    };
+    check(e.pc == a.pc, "PC");
+    check(e.a == a.a, "A");
+    check(e.x == a.x, "X");
+    check(e.y == a.y, "Y");
+    check(e.p == a.p, "P");
+    check(e.sp == a.sp, "SP");
+    check(!options.compare_ppu || (e.scanline == a.scanline && e.dot == a.dot),
+          "PPU");
+    check(!options.compare_cycles || e.cycles == a.cycles, "CYC");
+    return fields;
+  };
+
+  std::deque<std::pair<uint64_t, TraceRecord>> history;
+  uint64_t index = 0;
+  int divergences = 0;
+  bool diverged = false;
+
+  TraceRecord e;
+  TraceRecord a;
+  while (true) {
+    bool has_expected = expected(&e);
+    bool has_actual = actual(&a);
+    if (!has_expected || !has_actual) {
+      if (has_expected != has_actual) {
+        out << std::format("{} trace ends first, after {} records\n",
+                           has_expected ? "Actual" : "Expected", index);
+        divergences++;
+      }
+      break;
+    }
+
+    std::string fields = differences(e, a);
+    if (fields.empty()) {
+      if (diverged && divergences <= options.max_divergences) {
+        out << std::format("Traces agree again at record {}\n\n", index);
+      }
+      diverged = false;
+
+      history.emplace_back(index, e);
+      if (history.size() > static_cast<std::size_t>(options.context)) {
+        history.pop_front();
+      }
+    } else if (!diverged) {
+      diverged = true;
+      divergences++;
+      if (divergences <= options.max_divergences) {
+        out << std::format("Divergence {} at record {} ({}):\n",
+                           divergences, index, fields);
+        for (const auto &[i, record] : history) {
+          out << std::format("  {:>10} {}\n", i, record.ToString());
+        }
+        out << std::format("- {:>10} {}\n", index, e.ToString());
+        out << std::format("+ {:>10} {}\n", index, a.ToString());
+      }
+      history.clear();
+    }
+
+    index++;
+  }
+
+  if (divergences > options.max_divergences) {
+    out << std::format("... and {} more divergences\n",
+                       divergences - options.max_divergences);
+  }
+  out << std::format("{} records compared, {} divergences\n", index, divergences);
+  return divergences;
+}
+
+}  // namespace nes
@@ -0,0 +1,123 @@
+#ifndef NES_EMULATOR_TRACE_TRACE_H_
+#define NES_EMULATOR_TRACE_TRACE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpu/cpu.h"
+
+namespace nes {
+
+// CPU state before one instruction, the binary counterpart of a nestest.log
+// line. Records are written as-is (little-endian) after a "NTRC" header.
+struct TraceRecord {
+  uint64_t cycles = 0;
+  uint16_t pc = 0;
+  uint16_t scanline = 0;
+  uint16_t dot = 0;
+  uint8_t a = 0;
+  uint8_t x = 0;
+  uint8_t y = 0;
+  uint8_t p = 0;
+  uint8_t sp = 0;
+  uint8_t reserved = 0;
+
+  bool operator==(const TraceRecord &other) const = default;
+
+  // The PPU runs three dots per CPU cycle from power on, so its position is
+  // derived from the cycle count rather than read from a PPU that may not
+  // have caught up yet.
+  template <typename BusT>
+  static TraceRecord Capture(const BasicCpu<BusT> &cpu);
+
+  // Parses a nestest.log style line, e.g.
+  //   C000  4C F5 C5  JMP $C5F5    A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+  // The PPU field is optional.
+  static bool ParseNestestLine(std::string_view line, TraceRecord *record);
+
+  std::string ToString() const;
+};
+
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord is a file format");
+
+template <typename BusT>
+TraceRecord TraceRecord::Capture(const BasicCpu<BusT> &cpu) {
+  // See https://www.nesdev.org/wiki/PPU_rendering
+  constexpr uint64_t kDotsPerScanline = 341;
+  constexpr uint64_t kScanlines = 262;
+
+  uint64_t dots = cpu.cycles * 3 % (kDotsPerScanline * kScanlines);
+
+  TraceRecord record;
+  record.cycles = cpu.cycles;
+  record.pc = cpu.PC;
+  record.scanline = dots / kDotsPerScanline;
+  record.dot = dots % kDotsPerScanline;
+  record.a = cpu.A;
+  record.x = cpu.X;
+  record.y = cpu.Y;
+  record.p = cpu.status().raw;
+  record.sp = cpu.SP;
+  return record;
+}
+
+// Buffered binary trace sink, see Cpu::set_trace().
+class TraceWriter {
+ public:
+  ~TraceWriter();
+
+  bool Open(const std::string &path);
+  void Write(const TraceRecord &record) {
+    buffer_.push_back(record);
+    if (buffer_.size() == kBufferRecords) {
+      Flush();
+    }
+  }
+  void Flush();
+  bool Close();
+
+  uint64_t count() const { return count_; }
+
+ private:
+  static constexpr std::size_t kBufferRecords = 1 << 14;
+
+  std::ofstream ofs_;
+  std::vector<TraceRecord> buffer_;
+  uint64_t count_ = 0;
+};
+
+class TraceReader {
+ public:
+  bool Open(const std::string &path);
+  bool Next(TraceRecord *record);
+
+ private:
+  std::ifstream ifs_;
+  std::vector<TraceRecord> buffer_;
+  std::size_t pos_ = 0;
+};
+
+// Reports every place where two traces diverge: the records leading up to
+// it and the fields that differ. A divergence lasts until the traces agree
+// again, so a run that never recovers is reported once.
+struct TraceDiffOptions {
+  int context = 5;             // Matching records shown before a divergence.
+  int max_divergences = 20;    // Stop reporting after this many.
+  bool compare_ppu = true;
+  bool compare_cycles = true;
+};
+
+using TraceSource = std::function<bool(TraceRecord *record)>;
+
+// Returns the number of divergences found.
+int DiffTraces(const TraceSource &expected, const TraceSource &actual,
+               const TraceDiffOptions &options, std::ostream &out);
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_TRACE_TRACE_H_
@@ -0,0 +1,219 @@
+#include "pixels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NES_VIDEO_X86
+#endif
+
+namespace nes {
+
+namespace {
+
+void LookupPixelsScalar(const uint8_t *indices, int count,
+                        const uint32_t *palette, uint32_t *out) {
+  for (int i = 0; i < count; ++i) {
+    out[i] = palette[indices[i] & 0x3F];
+  }
+}
+
+void ScaleRowScalar(const uint32_t *in, int width, int factor,
+                    uint32_t *out) {
+  for (int i = 0; i < width; ++i) {
+    std::fill_n(out + i * factor, factor, in[i]);
+  }
+}
+
+void DuplicateRowScalar(uint32_t *row, int width, int stride, int copies) {
+  for (int i = 1; i <= copies; ++i) {
+    std::copy_n(row, width, row + i * stride);
+  }
+}
+
+#ifdef NES_VIDEO_X86
+
+// SSE2 has no gather. Four loads a store still halves the stores.
+__attribute__((target("sse2")))
+void LookupPixelsSse2(const uint8_t *indices, int count,
+                      const uint32_t *palette, uint32_t *out) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i pixels = _mm_setr_epi32(palette[indices[i] & 0x3F],
+                                    palette[indices[i + 1] & 0x3F],
+                                    palette[indices[i + 2] & 0x3F],
+                                    palette[indices[i + 3] & 0x3F]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), pixels);
+  }
+  LookupPixelsScalar(indices + i, count - i, palette, out + i);
+}
+
+__attribute__((target("avx2")))
+void LookupPixelsAvx2(const uint8_t *indices, int count,
+                      const uint32_t *palette, uint32_t *out) {
+  const __m256i mask = _mm256_set1_epi32(0x3F);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i));
+    __m256i offsets = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), mask);
+    __m256i pixels = _mm256_i32gather_epi32(
+        reinterpret_cast<const int *>(palette), offsets, 4);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), pixels);
+  }
+  LookupPixelsScalar(indices + i, count - i, palette, out + i);
+}
+
+// Factors 2 and 4 are lane shuffles; others take the scalar loop.
+__attribute__((target("sse2")))
+void ScaleRowSse2(const uint32_t *in, int width, int factor, uint32_t *out) {
+  if (factor != 2 && factor != 4) {
+    ScaleRowScalar(in, width, factor, out);
+    return;
+  }
+
+  int i = 0;
+  for (; i + 4 <= width; i += 4) {
+    __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    __m128i *dst = reinterpret_cast<__m128i *>(out + i * factor);
+    if (factor == 2) {
+      _mm_storeu_si128(dst, _mm_unpacklo_epi32(pixels, pixels));
+      _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(pixels, pixels));
+    } else {
+      _mm_storeu_si128(dst, _mm_shuffle_epi32(pixels, 0x00));
+      _mm_storeu_si128(dst + 1, _mm_shuffle_epi32(pixels, 0x55));
+      _mm_storeu_si128(dst + 2, _mm_shuffle_epi32(pixels, 0xAA));
+      _mm_storeu_si128(dst + 3, _mm_shuffle_epi32(pixels, 0xFF));
+    }
+  }
+  ScaleRowScalar(in + i, width - i, factor, out + i * factor);
+}
+
+__attribute__((target("avx2")))
+void ScaleRowAvx2(const uint32_t *in, int width, int factor, uint32_t *out) {
+  if (factor != 2 && factor != 4) {
+    ScaleRowScalar(in, width, factor, out);
+    return;
+  }
+
+  // Output vector k of 8 input pixels repeats pixels 8k / factor onwards.
+  __m256i spread[4];
+  for (int k = 0; k < factor; ++k) {
+    alignas(32) int lanes[8];
+    for (int j = 0; j < 8; ++j) {
+      lanes[j] = (k * 8 + j) / factor;
+    }
+    spread[k] = _mm256_load_si256(reinterpret_cast<const __m256i *>(lanes));
+  }
+
+  int i = 0;
+  for (; i + 8 <= width; i += 8) {
+    __m256i pixels =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+    __m256i *dst = reinterpret_cast<__m256i *>(out + i * factor);
+    for (int k = 0; k < factor; ++k) {
+      _mm256_storeu_si256(dst + k,
+                          _mm256_permutevar8x32_epi32(pixels, spread[k]));
+    }
+  }
+  ScaleRowScalar(in + i, width - i, factor, out + i * factor);
+}
+
+__attribute__((target("sse2")))
+void DuplicateRowSse2(uint32_t *row, int width, int stride, int copies) {
+  for (int c = 1; c <= copies; ++c) {
+    uint32_t *dst = row + c * stride;
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(dst + i),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+    }
+    std::copy(row + i, row + width, dst + i);
+  }
+}
+
+__attribute__((target("avx2")))
+void DuplicateRowAvx2(uint32_t *row, int width, int stride, int copies) {
+  for (int c = 1; c <= copies; ++c) {
+    uint32_t *dst = row + c * stride;
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(dst + i),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i)));
+    }
+    std::copy(row + i, row + width, dst + i);
+  }
+}
+
+#endif  // NES_VIDEO_X86
+
+SimdLevel level = DetectSimdLevel();
+
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+#ifdef NES_VIDEO_X86
+  // level is set by a static initializer, which may run before libgcc's.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SimdLevel::kSse2;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
+
+SimdLevel simd_level() {
+  return level;
+}
+
+void set_simd_level(SimdLevel new_level) {
+  level = std::min(new_level, DetectSimdLevel());
+}
+
+void LookupPixels(const uint8_t *indices, int count, const uint32_t *palette,
+                  uint32_t *out) {
+  switch (level) {
+#ifdef NES_VIDEO_X86
+    case SimdLevel::kAvx2:
+      return LookupPixelsAvx2(indices, count, palette, out);
+    case SimdLevel::kSse2:
+      return LookupPixelsSse2(indices, count, palette, out);
+#endif
+    default:
+      return LookupPixelsScalar(indices, count, palette, out);
+  }
+}
+
+void ScaleRow(const uint32_t *in, int width, int factor, uint32_t *out) {
+  switch (level) {
+#ifdef NES_VIDEO_X86
+    case SimdLevel::kAvx2:
+      return ScaleRowAvx2(in, width, factor, out);
+    case SimdLevel::kSse2:
+      return ScaleRowSse2(in, width, factor, out);
+#endif
+    default:
+      return ScaleRowScalar(in, width, factor, out);
+  }
+}
+
+void DuplicateRow(uint32_t *row, int width, int stride, int copies) {
+  switch (level) {
+#ifdef NES_VIDEO_X86
+    case SimdLevel::kAvx2:
+      return DuplicateRowAvx2(row, width, stride, copies);
+    case SimdLevel::kSse2:
+      return DuplicateRowSse2(row, width, stride, copies);
+#endif
+    default:
+      return DuplicateRowScalar(row, width, stride, copies);
+  }
+}
+
+}  // namespace nes
@@ -0,0 +1,42 @@
+#ifndef NES_EMULATOR_VIDEO_PIXELS_H_
+#define NES_EMULATOR_VIDEO_PIXELS_H_
+
+#include <cstdint>
+
+namespace nes {
+
+// Kernels for presenting frames: palette lookup, integer scaling and row
+// duplication. Pixels are 32-bit words holding R, G, B, A in memory
+// order, like raylib's Color.
+//
+// On x86 each kernel runs the widest of AVX2 and SSE2 the CPU has,
+// checked once at startup, so builds need no -mavx2. Elsewhere, or with
+// set_simd_level(kScalar), they are plain loops.
+
+enum class SimdLevel {
+  kScalar = 0,
+  kSse2,
+  kAvx2,
+};
+
+// The best level this CPU supports.
+SimdLevel DetectSimdLevel();
+SimdLevel simd_level();
+// For benchmarks and tests. Levels above DetectSimdLevel() are lowered
+// to it.
+void set_simd_level(SimdLevel level);
+
+// out[i] = palette[indices[i] & 0x3F], for count pixels.
+void LookupPixels(const uint8_t *indices, int count, const uint32_t *palette,
+                  uint32_t *out);
+
+// Nearest neighbour: each of the width pixels of in, factor times.
+void ScaleRow(const uint32_t *in, int width, int factor, uint32_t *out);
+
+// Copies the width pixels at row to the copies rows below it, stride
+// pixels apart.
+void DuplicateRow(uint32_t *row, int width, int stride, int copies);
+
+}  // namespace nes
+
+#endif  // NES_EMULATOR_VIDEO_PIXELS_H_
@@ -6,7 +6,13 @@ add_files(
    "utils/*.cc",
    "cartridge/*.cc",
    "ppu/*.cc",
-   "joypad/*.cc"
+   "joypad/*.cc",
+   "aot/*.cc",
+   "mapper/*.cc",
+   "index/*.cc",
+   "scheduler/*.cc",
+   "trace/*.cc",
+   "video/*.cc"
 )
 add_includedirs(".", { public = true })
 add_packages("raylib")
@@ -17,3 +23,22 @@ set_kind("binary")
 add_deps("nes")
 add_files("machine.cc")
 add_packages("raylib")
+
+
+target("nes-aot")
+set_kind("binary")
+add_deps("nes")
+add_files("nes_aot.cc")
+
+
+target("nes-trace")
+set_kind("binary")
+add_deps("nes")
+add_files("nes_trace.cc")
+
+
+target("nes-index")
+set_kind("binary")
+add_deps("nes")
+add_files("nes_index.cc")
+add_syslinks("pthread")
@@ -0,0 +1,66 @@
+// Battery-backed PRG RAM test: loads the same ROM into two cartridges and
+// checks a write through one doesn't show up in the other. Only the first
+// gets the .sav file; the second runs on RAM of its own.
+//
+// Usage: save_ram_test
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "cartridge/cartridge.h"
+
+int main() {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "nes_save_ram_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::filesystem::path rom = dir / "battery.nes";
+
+  // NROM with 16KB PRG ROM, 8KB CHR ROM and battery-backed PRG RAM.
+  std::vector<char> image(16 + 0x4000 + 0x2000, 0);
+  const char kHeader[] = { 'N', 'E', 'S', 0x1A, 1, 1, 0x02 };
+  std::copy(std::begin(kHeader), std::end(kHeader), image.begin());
+  std::ofstream(rom, std::ios::binary).write(image.data(), image.size());
+
+  int result = 0;
+  {
+    nes::Cartridge first;
+    nes::Cartridge second;
+    if (!first.LoadRomFile(rom) || !second.LoadRomFile(rom)) {
+      std::cout << std::format("Cannot load {}\n", rom.string());
+      return -1;
+    }
+    if (!first.save_ram.is_open() || second.save_ram.is_open()) {
+      std::cout << "Expected only the first cartridge to map the .sav\n";
+      result = -1;
+    }
+    if (first.prg_ram.size() != 0x2000 || second.prg_ram.size() != 0x2000) {
+      std::cout << "Expected 8KB of PRG RAM in each cartridge\n";
+      return -1;
+    }
+
+    first.prg_ram[0x10] = 0x5A;
+    second.prg_ram[0x20] = 0xA5;
+    if (second.prg_ram[0x10] != 0 || first.prg_ram[0x20] != 0) {
+      std::cout << "PRG RAM is shared between the cartridges\n";
+      result = -1;
+    }
+  }
+
+  // Both closed, so the save is free again and kept what the first wrote.
+  nes::Cartridge third;
+  if (!third.LoadRomFile(rom) || !third.save_ram.is_open() ||
+      third.prg_ram[0x10] != 0x5A) {
+    std::cout << "The .sav didn't keep the write\n";
+    result = -1;
+  }
+  third.save_ram.Close();
+  std::filesystem::remove_all(dir);
+
+  std::cout << (result == 0 ? "ok\n" : "FAILED\n");
+  return result;
+}
@@ -3,3 +3,8 @@ add_deps("nes")
 set_kind("binary")
 add_files("main.cc")
 add_packages("gtest")
+
+target("save_ram_test")
+add_deps("nes")
+set_kind("binary")
+add_files("save_ram_test.cc")
@@ -0,0 +1,93 @@
+// Headless CPU throughput benchmark: runs the snake program on the flat
+// test bus without a window and reports emulated cycles per second.
+// Timings on a busy machine swing a lot from one run to the next, so it
+// can repeat the run and report the best and the median.
+//
+// Usage: cpu_bench [cycles] [--cached] [--runs N]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cpu/cpu.h"
+#include "bus/flat_bus.h"
+#include "snake_program.h"
+
+namespace {
+
+// Runs snake from a fresh CPU and memory, returns emulated MHz.
+double Run(uint64_t budget, bool cached) {
+  std::array<uint8_t, 0x10000> memory = { 0 };
+  for (uint16_t i = 0; i < sizeof(kSnakeProgram); ++i) {
+    memory[0x0600 + i] = kSnakeProgram[i];
+  }
+
+  nes::FlatBus bus(memory);
+
+  nes::FlatCpu cpu(bus);
+  cpu.Reset();
+  cpu.PC = 0x0600;
+  cpu.set_block_cache_enabled(cached);
+
+  // xorshift32, so every run feeds the same "random" apples.
+  uint32_t seed = 0x12345678;
+  uint64_t ticks = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  while (cpu.cycles < budget) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    memory[0xFE] = seed;
+
+    cpu.Tick();
+    ticks++;
+
+    if (cpu.PC == 0x0735) {  // GameOver
+      cpu.Reset();
+      cpu.PC = 0x0600;
+      std::fill_n(memory.begin() + 0x0200, 0x05ff - 0x0200 + 1, 0);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double mhz = cpu.cycles / seconds / 1e6;
+  std::cout << std::format("{} cycles, {} ticks in {:.3f}s: {:.2f} MHz\n",
+                           cpu.cycles, ticks, seconds, mhz);
+  return mhz;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  uint64_t budget = 100000000;
+  bool cached = false;
+  int runs = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--cached") {
+      cached = true;
+    } else if (std::string(argv[i]) == "--runs" && i + 1 < argc) {
+      runs = std::max(1, std::stoi(argv[++i]));
+    } else {
+      budget = std::stoull(argv[i]);
+    }
+  }
+
+  std::vector<double> results;
+  for (int i = 0; i < runs; ++i) {
+    results.push_back(Run(budget, cached));
+  }
+  if (runs > 1) {
+    std::sort(results.begin(), results.end());
+    std::cout << std::format("best {:.2f} MHz, median {:.2f} MHz of {} runs\n",
+                             results.back(), results[runs / 2], runs);
+  }
+
+  return 0;
+}
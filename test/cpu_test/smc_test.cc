@@ -0,0 +1,180 @@
+// Self-modifying code test: runs random programs that rewrite their own
+// immediate operands on the flat test bus, once with the block cache and
+// once without, and checks both CPUs agree after every cached block.
+// Programs start on RAM, register and cartridge pages alike, since the
+// flat bus has RAM everywhere and mirrors nothing.
+//
+// Usage: smc_test [programs] [cycles]
+
+#include <array>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu/cpu.h"
+#include "bus/flat_bus.h"
+
+namespace {
+
+using Memory = std::array<uint8_t, 0x10000>;
+
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed * 2654435761u + 1) {}
+
+  // xorshift32
+  uint32_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+  int Below(int n) { return Next() % n; }
+
+ private:
+  uint32_t state_;
+};
+
+// Straight-line code ending in JMP back to its start. Every write lands on
+// the operand of an immediate instruction, so the program changes what it
+// computes but always stays valid code.
+void GenerateProgram(Random &random, Memory &memory, uint16_t start) {
+  const uint8_t kImmediate[] = {
+    0xA9,  // LDA #
+    0xA2,  // LDX #
+    0xA0,  // LDY #
+    0x69,  // ADC #
+    0x49,  // EOR #
+    0x29,  // AND #
+    0x09,  // ORA #
+    0xC9,  // CMP #
+  };
+  const uint8_t kImplied[] = {
+    0xE8,  // INX
+    0x88,  // DEY
+    0xAA,  // TAX
+    0x8A,  // TXA
+    0x18,  // CLC
+    0x38,  // SEC
+    0x0A,  // ASL A
+  };
+  const uint8_t kModify[] = {
+    0x8D,  // STA abs
+    0x8E,  // STX abs
+    0x8C,  // STY abs
+    0xEE,  // INC abs
+    0xCE,  // DEC abs
+    0x9D,  // STA abs,X
+  };
+
+  std::vector<uint16_t> operands;
+  std::vector<uint16_t> stores;  // Operand addresses of the writes.
+  uint16_t address = start;
+  int count = 16 + random.Below(48);
+  for (int i = 0; i < count; ++i) {
+    int kind = random.Below(4);
+    if (kind == 0) {
+      memory[address] = kImplied[random.Below(sizeof(kImplied))];
+      address += 1;
+    } else if (kind == 1 && !operands.empty()) {
+      uint8_t opcode = kModify[random.Below(sizeof(kModify))];
+      if (opcode == 0x9D) {
+        // Indexed by whatever X is, so clear it first.
+        memory[address] = 0xA2;  // LDX #0
+        memory[address + 1] = 0x00;
+        address += 2;
+      }
+      memory[address] = opcode;
+      stores.push_back(address + 1);
+      address += 3;
+    } else {
+      memory[address] = kImmediate[random.Below(sizeof(kImmediate))];
+      memory[address + 1] = random.Next();
+      operands.push_back(address + 1);
+      address += 2;
+    }
+  }
+  memory[address] = 0x4C;  // JMP start
+  memory[address + 1] = start & 0xFF;
+  memory[address + 2] = start >> 8;
+
+  // Targets are picked once the whole program is laid out, so writes also
+  // reach code further on.
+  for (uint16_t store : stores) {
+    uint16_t target = operands[random.Below(operands.size())];
+    memory[store] = target & 0xFF;
+    memory[store + 1] = target >> 8;
+  }
+}
+
+bool SameState(const nes::FlatCpu &a, const nes::FlatCpu &b) {
+  return a.PC == b.PC && a.A == b.A && a.X == b.X && a.Y == b.Y &&
+         a.SP == b.SP && a.status().raw == b.status().raw &&
+         a.cycles == b.cycles;
+}
+
+// Returns false and says where if the cached CPU goes its own way.
+bool RunProgram(int seed, uint64_t budget) {
+  // Internal RAM and its mirrors, the PPU registers and PRG ROM on the
+  // console, where the page of a write is easiest to get wrong.
+  const uint16_t kStarts[] = { 0x0300, 0x0800, 0x1F00, 0x2000, 0x4000,
+                               0x5F00, 0x6000, 0x8000, 0xC000, 0xFF00 };
+  Random random(seed);
+  auto memory = std::make_unique<Memory>();
+  uint16_t start = kStarts[random.Below(std::size(kStarts))] +
+                   random.Below(0xC0);
+  // The last page has to leave room for the program and the vectors.
+  if (start >= 0xFF00) {
+    start = 0xFE00 + random.Below(0x40);
+  }
+  GenerateProgram(random, *memory, start);
+
+  auto reference_memory = std::make_unique<Memory>(*memory);
+  nes::FlatBus bus(*memory);
+  nes::FlatBus reference_bus(*reference_memory);
+  nes::FlatCpu cpu(bus);
+  nes::FlatCpu reference(reference_bus);
+  for (nes::FlatCpu *c : { &cpu, &reference }) {
+    c->Reset();
+    c->PC = start;
+  }
+  cpu.set_block_cache_enabled(true);
+
+  while (cpu.cycles < budget) {
+    cpu.Tick();
+    while (reference.cycles < cpu.cycles) {
+      reference.Tick();
+    }
+    if (!SameState(cpu, reference) || *memory != *reference_memory) {
+      std::cout << std::format(
+          "program {} (${:04x}) differs at cycle {}: PC ${:04x}/${:04x} "
+          "A {:02x}/{:02x} X {:02x}/{:02x} Y {:02x}/{:02x}\n",
+          seed, start, cpu.cycles, cpu.PC, reference.PC, cpu.A, reference.A,
+          cpu.X, reference.X, cpu.Y, reference.Y);
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int programs = argc > 1 ? std::stoi(argv[1]) : 200;
+  uint64_t budget = argc > 2 ? std::stoull(argv[2]) : 20000;
+
+  int failed = 0;
+  for (int seed = 0; seed < programs; ++seed) {
+    if (!RunProgram(seed, budget)) {
+      failed++;
+    }
+  }
+  std::cout << std::format("{} of {} programs match\n", programs - failed,
+                           programs);
+
+  return failed == 0 ? 0 : -1;
+}
@@ -3,3 +3,13 @@ add_deps("nes")
 set_kind("binary")
 add_files("snake_test.cc")
 add_packages("raylib")
+
+target("cpu_bench")
+add_deps("nes")
+set_kind("binary")
+add_files("cpu_bench.cc")
+
+target("smc_test")
+add_deps("nes")
+set_kind("binary")
+add_files("smc_test.cc")
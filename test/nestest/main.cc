@@ -3,12 +3,15 @@
 #include <array>
 #include <string>
 #include <fstream>
+#include <vector>
 
 #include "bus/bus.h"
 #include "cpu/cpu.h"
 #include "ppu/ppu.h"
+#include "scheduler/scheduler.h"
 #include "cartridge/cartridge.h"
 #include "joypad/joypad.h"
+#include "trace/trace.h"
 #include "utils/assert.h"
 
 using namespace nes;
@@ -19,11 +22,12 @@ int main() {
   Joypad joypad;
   Bus bus;
   Cpu cpu(bus);
-  PPU ppu(cpu, cartridge);
-  bus.Connect(memory, cartridge, ppu, joypad);
-
+  Scheduler scheduler(cpu);
+  PPU ppu(cpu, cartridge, scheduler);
   cartridge.LoadRomFile("nestest.nes");
 
+  bus.Connect(memory, cartridge, ppu, joypad);
+
   cpu.Reset();
   cpu.PC = 0xC000;
   cpu.SP = 0xFD;
@@ -34,48 +38,50 @@ int main() {
     return 255;
   }
 
-  int cycles = 7;
-
-  while (true) {
-    std::string line = "";
-    std::size_t pos{};
-    if (!ifs.eof()) {
-      std::getline(ifs, line);
-      uint16_t pc{std::stoi(std::string(line, 0, 4), &pos, 16)};
-
-      nes_assert(pc == cpu.PC, std::format("PC assert failed, excepted value: {:#x}, actual: {:#x}", pc, cpu.PC));
-
-      uint8_t a{std::stoi(std::string(line, 50, 2), &pos, 16)};
-      nes_assert(a == cpu.A, std::format("A assert failed, excepted value: {:#x}, actual: {:#x}", a, cpu.A));
-
-      uint8_t x{std::stoi(std::string(line, 55, 2), &pos, 16)};
-      nes_assert(x == cpu.X, std::format("X assert failed, excepted value: {:#x}, actual: {:#x}", x, cpu.X));
+  // Reference states from the log, one per instruction.
+  std::vector<TraceRecord> expected;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    TraceRecord record;
+    nes_assert(TraceRecord::ParseNestestLine(line, &record),
+               std::format("Cannot parse nestest.log line {}: {}", expected.size() + 1, line));
+    expected.push_back(record);
+  }
 
-      uint8_t y{std::stoi(std::string(line, 60, 2), &pos, 16)};
-      nes_assert(y == cpu.Y, std::format("Y assert failed, excepted value: {:#x}, actual: {:#x}", y, cpu.Y));
+  TraceWriter writer;
+  if (!writer.Open("nestest.trace")) {
+    return 255;
+  }
+  cpu.set_trace(&writer);
 
-      uint8_t p{std::stoi(std::string(line, 65, 2), &pos, 16)};
-      nes_assert(p == cpu.P.raw, std::format("P assert failed, excepted value: {:#x}, actual: {:#x}", p, cpu.P.raw));
+  cpu.cycles = 7;  // The reset sequence.
 
-      int c{std::stoi(std::string(line, 90), &pos)};
-      nes_assert(cycles == c, std::format("cycles assert failed, excepted value: {}, actual: {}", c, cycles));
-    }
-    std::cout << std::format("${:04x} {:15} A:${:02x} X:${:02x} Y:${:02x} P:${:02x} SP:${:02x}, cycles:{}\n",
-                             cpu.PC,
-                             cpu.Disassemble(cpu.PC),
-                             cpu.A,
-                             cpu.X,
-                             cpu.Y,
-                             cpu.P.raw,
-                             cpu.SP,
-                             cycles);
-    nes_assert(memory[0x2] == 0, "");
+  for (std::size_t i = 0; i < expected.size(); ++i) {
     cpu.Tick();
+    nes_assert(memory[0x2] == 0, std::format("Error code ${:02x} at record {}", memory[0x2], i));
+  }
+  writer.Close();
 
-    cycles += cpu.cycles;
-
-    while (--cpu.cycles > 0);
+  // Compare everything and report all divergences, not just the first one.
+  // Only the CPU side matters here, skip the PPU column.
+  TraceReader actual;
+  if (!actual.Open("nestest.trace")) {
+    return 255;
   }
 
-  return 0;
+  TraceDiffOptions options;
+  options.compare_ppu = false;
+  std::size_t next = 0;
+  int divergences = DiffTraces(
+      [&expected, &next](TraceRecord *record) {
+        if (next == expected.size()) {
+          return false;
+        }
+        *record = expected[next++];
+        return true;
+      },
+      [&actual](TraceRecord *record) { return actual.Next(record); },
+      options, std::cout);
+
+  return divergences == 0 ? 0 : 1;
 }
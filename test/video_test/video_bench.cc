@@ -0,0 +1,113 @@
+// Frame presentation benchmark: converts an indexed frame to RGBA, as is
+// and scaled to the emulator window (4x3), with each SIMD level the CPU
+// has and with a straightforward loop, and checks they all agree.
+//
+// Usage: video_bench [frames]
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ppu/frame_buffer.h"
+#include "video/pixels.h"
+
+namespace {
+
+constexpr int kScaleX = 4;
+constexpr int kScaleY = 3;
+
+// What the kernels replace: a lookup and a store per output pixel.
+void RgbaLoop(const nes::FrameBuffer &frame, uint32_t *out) {
+  uint32_t palette[0x40];
+  std::memcpy(palette, nes::FrameBuffer::kColors.data(), sizeof(palette));
+
+  for (int i = 0; i < nes::FrameBuffer::kWidth * nes::FrameBuffer::kHeight;
+       ++i) {
+    out[i] = palette[frame.pixels[i] & 0x3F];
+  }
+}
+
+void ScaleLoop(const nes::FrameBuffer &frame, uint32_t *out) {
+  uint32_t palette[0x40];
+  std::memcpy(palette, nes::FrameBuffer::kColors.data(), sizeof(palette));
+
+  int stride = nes::FrameBuffer::kWidth * kScaleX;
+  for (int y = 0; y < nes::FrameBuffer::kHeight * kScaleY; ++y) {
+    for (int x = 0; x < stride; ++x) {
+      uint8_t index = frame.pixels[y / kScaleY * nes::FrameBuffer::kWidth +
+                                   x / kScaleX];
+      out[y * stride + x] = palette[index & 0x3F];
+    }
+  }
+}
+
+template <typename F>
+double Measure(int frames, F convert) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; ++i) {
+    convert();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+         frames;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int frames = argc > 1 ? std::stoi(argv[1]) : 2000;
+
+  // xorshift32 noise, emphasis off like the loops assume.
+  nes::FrameBuffer frame;
+  uint32_t seed = 0x12345678;
+  for (uint8_t &pixel : frame.pixels) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    pixel = seed & 0x3F;
+  }
+
+  constexpr int kPixels = nes::FrameBuffer::kWidth * nes::FrameBuffer::kHeight;
+  std::vector<uint32_t> expected_rgba(kPixels);
+  std::vector<uint32_t> expected(kPixels * kScaleX * kScaleY);
+  std::vector<uint32_t> rgba(kPixels);
+  std::vector<uint32_t> scaled(expected.size());
+
+  double rgba_loop_us =
+      Measure(frames, [&]() { RgbaLoop(frame, expected_rgba.data()); });
+  double scaled_loop_us =
+      Measure(frames, [&]() { ScaleLoop(frame, expected.data()); });
+  std::cout << std::format("{:8} {:>16} {:>16}\n", "", "rgba", "4x3");
+  std::cout << std::format("{:8} {:>8.2f}us {:>5} {:>8.2f}us\n", "loop",
+                           rgba_loop_us, "", scaled_loop_us);
+
+  const char *kNames[] = { "scalar", "sse2", "avx2" };
+  nes::SimdLevel best = nes::DetectSimdLevel();
+  int result = 0;
+  for (int level = 0; level <= static_cast<int>(best); ++level) {
+    nes::set_simd_level(static_cast<nes::SimdLevel>(level));
+
+    double rgba_us = Measure(frames, [&]() { frame.ToRgba(rgba.data()); });
+    double scaled_us = Measure(frames, [&]() {
+      frame.ToRgbaScaled(scaled.data(), kScaleX, kScaleY);
+    });
+
+    bool ok = rgba == expected_rgba && scaled == expected;
+    if (!ok) {
+      result = -1;
+    }
+
+    // Speedups over the loops.
+    std::cout << std::format(
+        "{:8} {:>8.2f}us {:>4.1f}x {:>8.2f}us {:>4.1f}x{}\n", kNames[level],
+        rgba_us, rgba_loop_us / rgba_us, scaled_us, scaled_loop_us / scaled_us,
+        ok ? "" : " MISMATCH");
+  }
+  nes::set_simd_level(best);
+
+  return result;
+}
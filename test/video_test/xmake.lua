@@ -0,0 +1,4 @@
+target("video_bench")
+add_deps("nes")
+set_kind("binary")
+add_files("video_bench.cc")
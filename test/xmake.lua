@@ -1 +1 @@
-includes("cpu_test", "cartridge_test", "tile_test", "nestest")
+includes("cpu_test", "cartridge_test", "tile_test", "nestest", "video_test")
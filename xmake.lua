@@ -18,5 +18,17 @@ add_cxflags("-Wall", "-Wextra", "-std=c++20")
 
 add_requires("raylib", "gtest")
 
+-- Profiling builds count CPU bus accesses per page and register, see
+-- src/bus/bus_stats.h. Off by default, the counters compile away.
+option("bus-stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count CPU bus accesses for nes-emulator --bus-stats")
+option_end()
+
+if has_config("bus-stats") then
+    add_defines("NES_BUS_STATS")
+end
+
 includes("src", "test")
 